@@ -0,0 +1,123 @@
+// Standalone perft driver: checks and times the move generator without R.
+//
+// Build from the package root, linking against R only for its headers and
+// the few R API functions the sources use:
+//
+//   cc -O3 -march=native $(R CMD config --cppflags) -Isrc -o perft_bench
+//     inst/bench/perft_bench.c $(ls src/*.c | grep -v init.c)
+//     $(R CMD config --ldflags)
+//
+// (all one command)
+//
+// Usage:
+//   perft_bench [suite.tsv [max_nodes]]   run the reference suite
+//   perft_bench --fen "<fen>" depth       perft of one position, divided
+//
+// The suite is inst/extdata/perft.tsv by default; rows expecting more than
+// max_nodes (default 1e8) are skipped. Exits nonzero if any count differs.
+
+#include "chess.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+static double now(void) {
+  struct timespec ts;
+  timespec_get(&ts, TIME_UTC);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static int run_fen(const char * fen, int depth) {
+  Chessboard board;
+  Color sideToMove;
+  const char * msg = parse_fen(&board, &sideToMove, fen, NULL);
+  if (msg) {
+    fprintf(stderr, "Invalid FEN: %s.\n", msg);
+    return 2;
+  }
+  MoveList list;
+  uint64_t nodes[MOVELIST_SIZE];
+  double t0 = now();
+  int n = divide(&board, sideToMove, depth, &list, nodes);
+  double seconds = now() - t0;
+  uint64_t total = 0;
+  for (int i = 0; i < n; ++i) {
+    char uci[6];
+    move16_to_uci(list.moves[i], uci);
+    printf("%s: %llu\n", uci, (unsigned long long)nodes[i]);
+    total += nodes[i];
+  }
+  printf("\nNodes: %llu  %.3fs  %.2f Mnps\n", (unsigned long long)total, seconds, total / seconds / 1e6);
+  return 0;
+}
+
+static int run_suite(const char * path, double max_nodes) {
+  FILE * f = fopen(path, "r");
+  if (f == NULL) {
+    fprintf(stderr, "Could not open %s.\n", path);
+    return 2;
+  }
+  char line[512];
+  if (fgets(line, sizeof(line), f) == NULL) { // header
+    fclose(f);
+    return 2;
+  }
+  int failures = 0;
+  uint64_t all_nodes = 0;
+  double all_seconds = 0;
+  printf("%-20s %5s %12s %9s %8s\n", "name", "depth", "nodes", "seconds", "Mnps");
+  while (fgets(line, sizeof(line), f)) {
+    char * name = strtok(line, "\t");
+    char * fen = strtok(NULL, "\t");
+    char * depth_s = strtok(NULL, "\t");
+    char * nodes_s = strtok(NULL, "\t\r\n");
+    if (name == NULL || fen == NULL || depth_s == NULL || nodes_s == NULL) {
+      continue;
+    }
+    uint64_t expected = strtoull(nodes_s, NULL, 10);
+    if ((double)expected > max_nodes) {
+      continue;
+    }
+    Chessboard board;
+    Color sideToMove;
+    const char * msg = parse_fen(&board, &sideToMove, fen, NULL);
+    if (msg) {
+      printf("%-20s invalid FEN: %s\n", name, msg);
+      ++failures;
+      continue;
+    }
+    double t0 = now();
+    uint64_t nodes = perft(&board, sideToMove, atoi(depth_s));
+    double seconds = now() - t0;
+    all_nodes += nodes;
+    all_seconds += seconds;
+    printf("%-20s %5s %12llu %9.3f %8.2f", name, depth_s, (unsigned long long)nodes,
+           seconds, seconds > 0 ? nodes / seconds / 1e6 : 0);
+    if (nodes != expected) {
+      printf("  FAIL: expected %llu", (unsigned long long)expected);
+      ++failures;
+    }
+    printf("\n");
+  }
+  fclose(f);
+  printf("\nTotal: %llu nodes  %.3fs  %.2f Mnps  %d failure(s)\n",
+         (unsigned long long)all_nodes, all_seconds,
+         all_seconds > 0 ? all_nodes / all_seconds / 1e6 : 0, failures);
+  return failures != 0;
+}
+
+int main(int argc, char ** argv) {
+  init_magics();
+  init_attacks();
+  init_zobrist();
+  if (argc >= 2 && strcmp(argv[1], "--fen") == 0) {
+    if (argc < 4) {
+      fprintf(stderr, "Usage: perft_bench --fen \"<fen>\" depth\n");
+      return 2;
+    }
+    return run_fen(argv[2], atoi(argv[3]));
+  }
+  const char * path = argc >= 2 ? argv[1] : "inst/extdata/perft.tsv";
+  double max_nodes = argc >= 3 ? atof(argv[2]) : 1e8;
+  return run_suite(path, max_nodes);
+}
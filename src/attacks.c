@@ -0,0 +1,54 @@
+#include "chess.h"
+
+// Attack tables for the non-sliding pieces, and the squares between and
+// through any two squares sharing a rank, file or diagonal. The latter use the
+// slider tables so init_magics() must have run.
+
+uint64_t KnightAttacks[64];
+uint64_t KingAttacks[64];
+uint64_t PawnAttacks[2][64];
+uint64_t BetweenBB[64][64];
+uint64_t LineBB[64][64];
+
+static uint64_t step_attacks(int p, const int deltas[][2], int n) {
+  uint64_t o = 0;
+  for (int d = 0; d < n; ++d) {
+    int r = (p >> 3) + deltas[d][0];
+    int c = (p & 7) + deltas[d][1];
+    if (r >= 0 && r < 8 && c >= 0 && c < 8) {
+      o |= BB((r << 3) + c);
+    }
+  }
+  return o;
+}
+
+void init_attacks(void) {
+  static const int KnightDeltas[8][2] = {{1, 2}, {2, 1}, {2, -1}, {1, -2}, {-1, -2}, {-2, -1}, {-2, 1}, {-1, 2}};
+  static const int KingDeltas[8][2] = {{1, 0}, {1, 1}, {0, 1}, {-1, 1}, {-1, 0}, {-1, -1}, {0, -1}, {1, -1}};
+  static const int WhitePawnDeltas[2][2] = {{1, -1}, {1, 1}};
+  static const int BlackPawnDeltas[2][2] = {{-1, -1}, {-1, 1}};
+
+  for (int p = 0; p < 64; ++p) {
+    KnightAttacks[p] = step_attacks(p, KnightDeltas, 8);
+    KingAttacks[p] = step_attacks(p, KingDeltas, 8);
+    PawnAttacks[0][p] = step_attacks(p, WhitePawnDeltas, 2);
+    PawnAttacks[1][p] = step_attacks(p, BlackPawnDeltas, 2);
+  }
+
+  for (int p = 0; p < 64; ++p) {
+    for (int q = 0; q < 64; ++q) {
+      BetweenBB[p][q] = 0;
+      LineBB[p][q] = 0;
+      if (p == q) {
+        continue;
+      }
+      if (bishopAttacks(p, 0) & BB(q)) {
+        BetweenBB[p][q] = bishopAttacks(p, BB(q)) & bishopAttacks(q, BB(p));
+        LineBB[p][q] = (bishopAttacks(p, 0) & bishopAttacks(q, 0)) | BB(p) | BB(q);
+      } else if (rookAttacks(p, 0) & BB(q)) {
+        BetweenBB[p][q] = rookAttacks(p, BB(q)) & rookAttacks(q, BB(p));
+        LineBB[p][q] = (rookAttacks(p, 0) & rookAttacks(q, 0)) | BB(p) | BB(q);
+      }
+    }
+  }
+}
@@ -1,86 +1,77 @@
 #include "chess.h"
 
 #define MAX_MOVES 5050
-#define LONG_GAME 255
 
 #define OPPCOLOR (sideToMove == WHITE ? BLACK : WHITE)
 
 const char * abcdefgh_ = "abcdefgh";
 
-typedef enum {
-  EMPTY,
-  PAWN,
-  KNIGHT,
-  BISHOP,
-  ROOK,
-  QUEEN,
-  KING
-} Piece;
-
-typedef enum {
-  WHITE,
-  BLACK
-} Color;
-
-typedef struct {
-  Piece piece;
-  Color color;
-} Square;
+// All writes to board->board must go through here so that the
+// bitboards describe the same position as the mailbox.
+void setSquare(Chessboard * board, int row, int col, Piece P, Color C) {
+  unsigned int p = rowcol2p(row, col);
+  uint64_t b = BB(p);
+  Square old = board->board[row][col];
+  if (old.piece != EMPTY) {
+    board->pieceBB[old.color][old.piece] ^= b;
+    board->colorBB[old.color] ^= b;
+    board->occupiedBB ^= b;
+    board->key ^= ZobristPiece[old.color][old.piece][p];
+  }
+  board->board[row][col].piece = P;
+  board->board[row][col].color = C;
+  if (P != EMPTY) {
+    board->pieceBB[C][P] ^= b;
+    board->colorBB[C] ^= b;
+    board->occupiedBB ^= b;
+    board->key ^= ZobristPiece[C][P][p];
+  }
+}
 
-typedef struct {
-  unsigned int fromRow : 3;
-  unsigned int fromCol : 3;
-  unsigned int toRow : 3;
-  unsigned int toCol : 3;
-  Piece toPiece; // relevant for promotions and to signify starting position
-} Move;
+void clearSquare(Chessboard * board, int row, int col) {
+  setSquare(board, row, col, EMPTY, WHITE);
+}
 
-typedef struct {
-  Square board[8][8];
-  unsigned int WhiteKing : 6; // duplicately record the kings' positions
-  unsigned int BlackKing : 6;
-  bool WhiteMayCastle : 1;
-  bool BlackMayCastle: 1;
-  Move lastMove;
-} Chessboard;
-
-unsigned int pos_hash(Chessboard * B) {
-  unsigned int o = 0;
-  // unsigned int tbl[64][7] = {0};
-
-  for (int r = 0; r < 8; ++r) {
-    for (int c = 0; c < 8; ++c) {
-      Piece PP = B->board[r][c].piece;
-      // bool is_white = B->board[r][c].color;
-      o += 2 * (PP);
-    }
+// rights: 1 kingside, 2 queenside, 3 both
+void setCastlingRights(Chessboard * board, Color C, unsigned int rights) {
+  unsigned int old = (C == WHITE) ? board->WhiteMayCastle : board->BlackMayCastle;
+  board->key ^= ZobristCastling[C][old] ^ ZobristCastling[C][rights];
+  if (C == WHITE) {
+    board->WhiteMayCastle = rights;
+  } else {
+    board->BlackMayCastle = rights;
   }
-  return o;
 }
 
+// Any move from or to a king's or rook's home square forfeits the
+// corresponding castling rights (moving the piece, or capturing the rook).
+void updateCastlingRights(Chessboard * board, unsigned int p) {
+  switch(p) {
+  case 4:
+    setCastlingRights(board, WHITE, 0);
+    break;
+  case 0:
+    setCastlingRights(board, WHITE, board->WhiteMayCastle & 1);
+    break;
+  case 7:
+    setCastlingRights(board, WHITE, board->WhiteMayCastle & 2);
+    break;
+  case 60:
+    setCastlingRights(board, BLACK, 0);
+    break;
+  case 56:
+    setCastlingRights(board, BLACK, board->BlackMayCastle & 1);
+    break;
+  case 63:
+    setCastlingRights(board, BLACK, board->BlackMayCastle & 2);
+    break;
+  }
+}
 
+uint64_t pos_hash(const Chessboard * B) {
+  return B->key;
+}
 
-typedef struct {
-  unsigned int P : 3;
-  unsigned int Q : 3;
-  unsigned int R : 3;
-  unsigned int N : 3;
-  unsigned int B_light : 3;
-  unsigned int B_dark : 3;
-  unsigned int bishop_pair : 1;
-} Material;
-
-typedef struct {
-  Chessboard Board;
-  Color sideToMove;
-  Move Moves[LONG_GAME][2];
-  uint16_t white_material[LONG_GAME];
-  uint16_t black_material[LONG_GAME];
-  unsigned int move : 8;
-  unsigned int whiteLostCastlingRights : 8;
-  unsigned int blackLostCastlingRights : 8;
-  unsigned int last_pawn_move : 8;
-} Game;
 
 
 typedef struct {
@@ -121,46 +112,18 @@ void print_the_piece(Piece P) {
   if (P == ROOK) Rprintf("ROOK");
 }
 
-const char * strWHITE = "WHITE";
-const char * strBLACK = "BLACK";
-
-#define color2str (sideToMove == WHITE ? strWHITE : strBLACK)
-
-
 void print_piece(Chessboard * board, int row, int col) {
   print_the_piece(board->board[row][col].piece);
 }
 
 void determine_material(Material * M, const Chessboard * board, Color C) {
-  for (int r = 0; r < 8; ++r) {
-    for (int c = 0; c < 8; ++c) {
-      if (board->board[r][c].piece == EMPTY || board->board[r][c].color != C) {
-        continue;
-      }
-      switch(board->board[r][c].piece) {
-      case PAWN:
-        M->P++;
-        break;
-      case QUEEN:
-        M->Q++;
-        break;
-      case ROOK:
-        M->R++;
-        break;
-      case BISHOP:
-        if (is_light_square(r, c)) {
-          M->B_light++;
-        } else {
-          M->B_dark++;
-        }
-        break;
-      case KNIGHT:
-        M->N++;
-      default:
-        continue;
-      }
-    }
-  }
+  const uint64_t * bb = board->pieceBB[C];
+  M->P = popcount64(bb[PAWN]);
+  M->Q = popcount64(bb[QUEEN]);
+  M->R = popcount64(bb[ROOK]);
+  M->N = popcount64(bb[KNIGHT]);
+  M->B_light = popcount64(bb[BISHOP] & LIGHT_SQUARES);
+  M->B_dark = popcount64(bb[BISHOP] & ~LIGHT_SQUARES);
   M->bishop_pair = M->B_dark && M->B_light;
 }
 
@@ -184,59 +147,66 @@ unsigned int total_material(Material * M) {
   return o;
 }
 
-void blankBoard(Chessboard * board) {
-  for (int c = 0; c < 8; ++c) {
-    for (int r = 0; r < 8; ++r) {
-      board->board[r][c].piece = EMPTY;
-      board->board[r][c].color = WHITE;
-    }
-  }
+// The material of side C on the board, as total_material() values it
+int material_score(const Chessboard * board, Color C) {
+  Material M;
+  determine_material(&M, board, C);
+  return (int)total_material(&M);
 }
 
-void startingPosition(Chessboard* board) {
-  for (int c = 0; c < 8; ++c) {
-    for (int r = 0; r < 6; ++r) {
-      board->board[r][c].piece = EMPTY;
-      board->board[r][c].color = WHITE;
+// Add (delta = 1) or remove (delta = -1) a piece standing on square p
+void adjust_material(Material * M, Piece P, unsigned int p, int delta) {
+  switch (P) {
+  case PAWN:
+    M->P += delta;
+    break;
+  case KNIGHT:
+    M->N += delta;
+    break;
+  case BISHOP:
+    if ((LIGHT_SQUARES >> p) & 1) {
+      M->B_light += delta;
+    } else {
+      M->B_dark += delta;
     }
+    M->bishop_pair = M->B_dark && M->B_light;
+    break;
+  case ROOK:
+    M->R += delta;
+    break;
+  case QUEEN:
+    M->Q += delta;
+    break;
+  default:
+    break;
   }
-  for (int c = 0; c < 8; ++c) {
-    board->board[1][c].piece = PAWN;
-    board->board[1][c].color = WHITE;
-    board->board[6][c].piece = PAWN;
-    board->board[6][c].color = WHITE;
-  }
-  board->board[0][0].piece = ROOK;
-  board->board[0][7].piece = ROOK;
-  board->board[7][0].piece = ROOK;
-  board->board[7][7].piece = ROOK;
-
-  board->board[0][1].piece = KNIGHT;
-  board->board[0][6].piece = KNIGHT;
-  board->board[7][1].piece = KNIGHT;
-  board->board[7][6].piece = KNIGHT;
-
-  board->board[0][2].piece = BISHOP;
-  board->board[0][5].piece = BISHOP;
-  board->board[7][2].piece = BISHOP;
-  board->board[7][5].piece = BISHOP;
-
-  board->board[0][3].piece = QUEEN;
-  board->board[7][3].piece = QUEEN;
+}
 
-  board->board[0][4].piece = KING;
-  board->board[7][4].piece = KING;
+void blankBoard(Chessboard * board) {
+  // EMPTY and WHITE are both zero
+  memset(board->board, 0, sizeof(board->board));
+  memset(board->pieceBB, 0, sizeof(board->pieceBB));
+  memset(board->colorBB, 0, sizeof(board->colorBB));
+  board->occupiedBB = 0;
+  board->WhiteMayCastle = 0;
+  board->BlackMayCastle = 0;
+  board->key = 0;
+}
 
+void startingPosition(Chessboard* board) {
+  const Piece backRank[8] = {ROOK, KNIGHT, BISHOP, QUEEN, KING, BISHOP, KNIGHT, ROOK};
+  blankBoard(board);
   for (int c = 0; c < 8; ++c) {
-    for (int r = 6; r < 8; ++r) {
-      board->board[r][c].color = BLACK;
-    }
+    setSquare(board, 0, c, backRank[c], WHITE);
+    setSquare(board, 1, c, PAWN, WHITE);
+    setSquare(board, 6, c, PAWN, BLACK);
+    setSquare(board, 7, c, backRank[c], BLACK);
   }
   board->WhiteKing = 4;
   board->BlackKing = 60;
 
-  board->WhiteMayCastle = 1;
-  board->BlackMayCastle = 1;
+  setCastlingRights(board, WHITE, 3);
+  setCastlingRights(board, BLACK, 3);
 
   board->lastMove.fromCol = 0;
   board->lastMove.fromRow = 0;
@@ -256,14 +226,29 @@ void initialize_Game(Game * G) {
   memset(G->Moves, 0, LONG_GAME * sizeof(Move));
   memset(G->black_material, 0, LONG_GAME * sizeof(uint16_t));
   memset(G->white_material, 0, LONG_GAME * sizeof(uint16_t));
-  Material M;
-  determine_material(&M, &(G->Board), WHITE);
-  G->white_material[0] = total_material(&M);
-  G->black_material[0] = total_material(&M);
+  determine_material(&(G->material[WHITE]), &(G->Board), WHITE);
+  determine_material(&(G->material[BLACK]), &(G->Board), BLACK);
+  G->white_material[0] = total_material(&(G->material[WHITE]));
+  G->black_material[0] = total_material(&(G->material[BLACK]));
   G->whiteLostCastlingRights = LONG_GAME;
   G->blackLostCastlingRights = LONG_GAME;
 }
 
+// A game from the position fen rather than the start. Returns NULL, or
+// what was wrong with the FEN.
+const char * initialize_Game_fen(Game * G, const char * fen) {
+  initialize_Game(G);
+  const char * msg = parse_fen(&(G->Board), &(G->sideToMove), fen, NULL);
+  if (msg) {
+    return msg;
+  }
+  determine_material(&(G->material[WHITE]), &(G->Board), WHITE);
+  determine_material(&(G->material[BLACK]), &(G->Board), BLACK);
+  G->white_material[0] = total_material(&(G->material[WHITE]));
+  G->black_material[0] = total_material(&(G->material[BLACK]));
+  return NULL;
+}
+
 // returns cols[j] = 1 if pawn in column j can take to the right, = -1 can take to left, 0 cannot take enpassant
 void colsMayEnPassant(int cols[8], const Chessboard * board) {
   Move lastMove = board->lastMove;
@@ -280,48 +265,113 @@ void colsMayEnPassant(int cols[8], const Chessboard * board) {
   if (board->board[lastMove.toRow][lastMove.toCol].piece != PAWN) {
     return;
   }
-  if (lastMove.toCol == 0) {
-    if (lastMove.toRow == 4) {
-      if (board->board[4][1].piece == PAWN && board->board[4][1].color == WHITE) {
-        cols[1] = -1;
-        return;
-      }
-    } else {
-      if (board->board[3][1].piece == PAWN && board->board[3][1].color == BLACK) {
-        cols[1] = -1;
-        return;
-      }
-    }
+  // the capturing pawn must stand beside the one that just moved
+  int r = lastMove.toRow;
+  int c = lastMove.toCol;
+  Color capturer = (r == 3) ? BLACK : WHITE;
+  if (c > 0 && board->board[r][c - 1].piece == PAWN && board->board[r][c - 1].color == capturer) {
+    cols[c - 1] = 1;
   }
-  if (lastMove.toCol == 7) {
-    if (lastMove.toRow == 3) {
-      if (board->board[4][6].piece == PAWN && board->board[4][6].color == BLACK) {
-        cols[6] = 1;
-        return;
-      }
-    } else {
-      if (board->board[3][6].piece == PAWN && board->board[3][6].color == WHITE) {
-        cols[6] = 1;
-        return;
-      }
-    }
+  if (c < 7 && board->board[r][c + 1].piece == PAWN && board->board[r][c + 1].color == capturer) {
+    cols[c + 1] = -1;
   }
-  int c = lastMove.toCol;
-  if (lastMove.toRow == 3) {
-    if (board->board[3][c - 1].piece == PAWN && board->board[3][c - 1].color == BLACK) {
-      cols[c - 1] = 1;
-    }
-    if (board->board[3][c + 1].piece == PAWN && board->board[3][c + 1].color == BLACK) {
-      cols[c + 1] = -1;
+}
+
+// The en passant file is part of the key only when the capture is available
+uint64_t enPassantKey(const Chessboard * board) {
+  int cols[8];
+  colsMayEnPassant(cols, board);
+  for (int j = 0; j < 8; ++j) {
+    if (cols[j]) {
+      return ZobristEnPassant[board->lastMove.toCol];
     }
-  } else {
-    if (board->board[4][c - 1].piece == PAWN && board->board[4][c - 1].color == WHITE) {
-      cols[c - 1] = 1;
+  }
+  return 0;
+}
+
+// Coordinate notation, e.g. e2e4, e7e8q, e1g1 for castling
+void move16_to_uci(Move16 m, char out[6]) {
+  unsigned int from = MOVE16_FROM(m);
+  unsigned int to = MOVE16_TO(m);
+  out[0] = abcdefgh_[p2col(from)];
+  out[1] = '1' + p2row(from);
+  out[2] = abcdefgh_[p2col(to)];
+  out[3] = '1' + p2row(to);
+  out[4] = '\0';
+  if (MOVE16_KIND(m) == MOVE_PROMOTION) {
+    out[4] = "nbrq"[MOVE16_PROMOTED(m) - KNIGHT];
+    out[5] = '\0';
+  }
+}
+
+// Play m on the board in place
+void make_move(Chessboard * board, Move16 m, Undo * u) {
+  const unsigned int from = MOVE16_FROM(m);
+  const unsigned int to = MOVE16_TO(m);
+  const int fromRow = p2row(from), fromCol = p2col(from);
+  const int toRow = p2row(to), toCol = p2col(to);
+  const unsigned int kind = MOVE16_KIND(m);
+  Square mover = board->board[fromRow][fromCol];
+  u->WhiteKing = board->WhiteKing;
+  u->BlackKing = board->BlackKing;
+  u->WhiteMayCastle = board->WhiteMayCastle;
+  u->BlackMayCastle = board->BlackMayCastle;
+  u->lastMove = board->lastMove;
+  u->key = board->key;
+  uint64_t enpassant_key = enPassantKey(board);
+
+  Piece placed = (kind == MOVE_PROMOTION) ? MOVE16_PROMOTED(m) : (Piece)mover.piece;
+  const int capturedRow = (kind == MOVE_ENPASSANT) ? fromRow : toRow;
+  u->captured = board->board[capturedRow][toCol];
+  if (u->captured.piece != EMPTY) {
+    clearSquare(board, capturedRow, toCol);
+  }
+  clearSquare(board, fromRow, fromCol);
+  setSquare(board, toRow, toCol, placed, mover.color);
+
+  if (mover.piece == KING) {
+    if (mover.color == WHITE) {
+      board->WhiteKing = to;
+    } else {
+      board->BlackKing = to;
     }
-    if (board->board[4][c + 1].piece == PAWN && board->board[4][c + 1].color == WHITE) {
-      cols[c + 1] = -1;
+    if (kind == MOVE_CASTLING) {
+      clearSquare(board, toRow, toCol == 6 ? 7 : 0);
+      setSquare(board, toRow, toCol == 6 ? 5 : 3, ROOK, mover.color);
     }
   }
+  updateCastlingRights(board, from);
+  updateCastlingRights(board, to);
+
+  board->lastMove.fromRow = fromRow;
+  board->lastMove.fromCol = fromCol;
+  board->lastMove.toRow = toRow;
+  board->lastMove.toCol = toCol;
+  board->lastMove.toPiece = placed;
+  board->key ^= enpassant_key ^ enPassantKey(board) ^ ZobristSide;
+}
+
+void unmake_move(Chessboard * board, Move16 m, const Undo * u) {
+  const unsigned int from = MOVE16_FROM(m);
+  const unsigned int to = MOVE16_TO(m);
+  const int toRow = p2row(to), toCol = p2col(to);
+  const unsigned int kind = MOVE16_KIND(m);
+  Square mover = board->board[toRow][toCol];
+  if (kind == MOVE_CASTLING) {
+    clearSquare(board, toRow, toCol == 6 ? 5 : 3);
+    setSquare(board, toRow, toCol == 6 ? 7 : 0, ROOK, mover.color);
+  }
+  clearSquare(board, toRow, toCol);
+  setSquare(board, p2row(from), p2col(from), (Piece)(kind == MOVE_PROMOTION ? PAWN : mover.piece), mover.color);
+  if (u->captured.piece != EMPTY) {
+    setSquare(board, kind == MOVE_ENPASSANT ? (int)p2row(from) : toRow, toCol, u->captured.piece, u->captured.color);
+  }
+  board->WhiteKing = u->WhiteKing;
+  board->BlackKing = u->BlackKing;
+  board->WhiteMayCastle = u->WhiteMayCastle;
+  board->BlackMayCastle = u->BlackMayCastle;
+  board->lastMove = u->lastMove;
+  board->key = u->key;
 }
 
 bool isMoveLegal(const Chessboard* board, const Move* move) {
@@ -403,1563 +453,786 @@ bool isMoveLegal(const Chessboard* board, const Move* move) {
 
 
 
-bool canPieceAttackSquare(const Chessboard* board, int pieceRow, int pieceCol, int toRow, int toCol) {
-  Square pieceSquare = board->board[pieceRow][pieceCol];
-  Piece pieceType = pieceSquare.piece;
-  Color pieceColor = pieceSquare.color;
+int locateKing(const Chessboard * board, Color kingColor) {
+  return kingColor == WHITE ? board->WhiteKing : board->BlackKing;
+}
 
-  // Check if the target square is out of bounds
-  if (toRow < 0 || toRow >= 8 || toCol < 0 || toCol >= 8) {
-    return false;
-  }
+// Pieces of either colour that attack square p, for the given occupancy
+uint64_t attackersTo(const Chessboard * board, unsigned int p, uint64_t occupied) {
+  const uint64_t (*P)[7] = board->pieceBB;
+  uint64_t bishops = P[WHITE][BISHOP] | P[BLACK][BISHOP] | P[WHITE][QUEEN] | P[BLACK][QUEEN];
+  uint64_t rooks = P[WHITE][ROOK] | P[BLACK][ROOK] | P[WHITE][QUEEN] | P[BLACK][QUEEN];
+  return
+    (PawnAttacks[BLACK][p] & P[WHITE][PAWN]) |
+    (PawnAttacks[WHITE][p] & P[BLACK][PAWN]) |
+    (KnightAttacks[p] & (P[WHITE][KNIGHT] | P[BLACK][KNIGHT])) |
+    (KingAttacks[p] & (P[WHITE][KING] | P[BLACK][KING])) |
+    (bishopAttacks(p, occupied) & bishops) |
+    (rookAttacks(p, occupied) & rooks);
+}
 
-  // Check if the piece can attack the target square based on its type
-  switch (pieceType) {
-  case PAWN: {
-    // Determine the direction of the pawn's movement based on its color
-    int direction = (pieceColor == WHITE) ? 1 : -1;
+// Is square p attacked by a piece of colour byColor? Looks outward from p,
+// asking whether each kind of piece could reach it, cheapest first. The
+// occupancy is a parameter so the king can be lifted when it steps away.
+static inline bool isSquareAttackedOcc(const Chessboard * board, unsigned int p, Color byColor, uint64_t occupied) {
+  const uint64_t * P = board->pieceBB[byColor];
+  return
+    (PawnAttacks[byColor == WHITE ? BLACK : WHITE][p] & P[PAWN]) ||
+    (KnightAttacks[p] & P[KNIGHT]) ||
+    (KingAttacks[p] & P[KING]) ||
+    (bishopAttacks(p, occupied) & (P[BISHOP] | P[QUEEN])) ||
+    (rookAttacks(p, occupied) & (P[ROOK] | P[QUEEN]));
+}
 
-    // Check if the pawn can attack the target square diagonally
-    if (toCol == pieceCol + 1 || toCol == pieceCol - 1) {
-      if (toRow == pieceRow + direction) {
-        return true;
-      }
-    }
+bool isSquareAttacked(const Chessboard * board, unsigned int p, Color byColor) {
+  return isSquareAttackedOcc(board, p, byColor, board->occupiedBB);
+}
+
+bool isKingInCheck(const Chessboard* board, Color kingColor) {
+  return isSquareAttacked(board, locateKing(board, kingColor), kingColor == WHITE ? BLACK : WHITE);
+}
+
+// Everything the generator needs to know about the king of the side to move,
+// computed once per position so that no move has to be tried on the board.
+typedef struct {
+  unsigned int king;
+  uint64_t checkers; // enemy pieces giving check
+  uint64_t pinned; // own pieces that may only move along the line to the king
+  uint64_t evasions; // targets that answer the check: all squares if none, none if double check
+} CheckInfo;
+
+void computeCheckInfo(const Chessboard * board, Color C, CheckInfo * ci) {
+  const Color them = (C == WHITE) ? BLACK : WHITE;
+  const uint64_t occupied = board->occupiedBB;
+  const unsigned int k = locateKing(board, C);
+  ci->king = k;
+  ci->checkers = attackersTo(board, k, occupied) & board->colorBB[them];
+  ci->pinned = 0;
+
+  // enemy sliders that would see the king on an empty board, and have
+  // exactly one piece, ours, in the way
+  uint64_t snipers =
+    (rookAttacks(k, 0) & (board->pieceBB[them][ROOK] | board->pieceBB[them][QUEEN])) |
+    (bishopAttacks(k, 0) & (board->pieceBB[them][BISHOP] | board->pieceBB[them][QUEEN]));
+  while (snipers) {
+    unsigned int s = pop_lsb(&snipers);
+    uint64_t blockers = BetweenBB[k][s] & occupied;
+    if (popcount64(blockers) == 1 && (blockers & board->colorBB[C])) {
+      ci->pinned |= blockers;
+    }
+  }
+
+  switch (popcount64(ci->checkers)) {
+  case 0:
+    ci->evasions = ~((uint64_t)0);
     break;
+  case 1: {
+    // capture the checker or interpose (nothing to interpose against a leaper)
+    unsigned int s = lsb64(ci->checkers);
+    ci->evasions = ci->checkers | BetweenBB[k][s];
   }
-
-  case KNIGHT: {
-    // Check if the target square is a valid knight's move away from the piece
-    int rowDiff = abs(toRow - pieceRow);
-    int colDiff = abs(toCol - pieceCol);
-    if ((rowDiff == 2 && colDiff == 1) || (rowDiff == 1 && colDiff == 2)) {
-      return true;
-    }
     break;
+  default:
+    ci->evasions = 0;
   }
+}
 
-  case BISHOP: {
-    // Check if the target square is on the same diagonal as the piece
-    if (abs(toRow - pieceRow) == abs(toCol - pieceCol)) {
-    // Determine the direction of movement along the diagonal
-    int rowDirection = (toRow > pieceRow) ? 1 : -1;
-    int colDirection = (toCol > pieceCol) ? 1 : -1;
+// Squares the piece on p may legally move to, before considering its own
+// movement: answer any check, and stay on the pin line if pinned
+static uint64_t legalTargets(const Chessboard * board, const CheckInfo * ci, unsigned int p) {
+  uint64_t o = ci->evasions & ~(board->colorBB[board->board[p2row(p)][p2col(p)].color]);
+  if (ci->pinned & BB(p)) {
+    o &= LineBB[ci->king][p];
+  }
+  return o;
+}
 
-    int row = pieceRow + rowDirection;
-    int col = pieceCol + colDirection;
 
-    // Check if there are any pieces obstructing the path
-    while (row != toRow && col != toCol) {
-      if (board->board[row][col].piece != EMPTY) {
-        return false; // Obstruction in the path
-      }
-      row += rowDirection;
-      col += colDirection;
-    }
+// Helper function to add a move to the list
+static inline void addMove(MoveList * list, unsigned int from, unsigned int to, unsigned int kind) {
+  list->moves[list->n++] = MOVE16(from, to, kind);
+}
 
-    return true; // No obstructions, the bishop can attack the target square
+// One move per target square
+static void addMoves(MoveList * list, unsigned int from, uint64_t targets) {
+  while (targets) {
+    addMove(list, from, pop_lsb(&targets), MOVE_NORMAL);
   }
-    break;
+}
+
+// A pawn reaching the last rank becomes each of queen, rook, bishop and knight
+static void addPawnMove(MoveList * list, unsigned int from, unsigned int to) {
+  if (to >= 8 && to < 56) {
+    addMove(list, from, to, MOVE_NORMAL);
+    return;
   }
+  for (Piece P = QUEEN; P >= KNIGHT; --P) {
+    list->moves[list->n++] = MOVE16(from, to, MOVE_PROMOTION) | ((P - KNIGHT) << 12);
+  }
+}
 
-  case ROOK:
-    // Check if the target square is in the same row or column as the piece
-    if (toRow == pieceRow || toCol == pieceCol) {
-      // Determine the direction of movement along the row or column
-      int rowDirection = (toRow > pieceRow) ? 1 : (toRow < pieceRow) ? -1 : 0;
-      int colDirection = (toCol > pieceCol) ? 1 : (toCol < pieceCol) ? -1 : 0;
-
-      int row = pieceRow + rowDirection;
-      int col = pieceCol + colDirection;
-
-      // Check if there are any pieces obstructing the path
-      while (row != toRow || col != toCol) {
-        if (board->board[row][col].piece != EMPTY) {
-          return false; // Obstruction in the path
-        }
-        row += rowDirection;
-        col += colDirection;
-      }
 
-      return true; // No obstructions, the rook can attack the target square
+// Function to generate pawn moves
+void generatePawnMoves(const Chessboard* board, const CheckInfo * ci, int row, int col, MoveList * list) {
+  const unsigned int p = rowcol2p(row, col);
+  const Color C = board->board[row][col].color;
+  const Color them = (C == WHITE) ? BLACK : WHITE;
+  const int direction = (C == WHITE) ? 1 : -1;
+  const uint64_t allowed = legalTargets(board, ci, p);
+
+  // pushes: one square forward, or two from the starting rank, onto empty squares
+  int toRow = row + direction;
+  if (board->board[toRow][col].piece == EMPTY) {
+    if (allowed & BB(rowcol2p(toRow, col))) {
+      addPawnMove(list, p, rowcol2p(toRow, col));
     }
-    break;
-
-  case QUEEN: {
-    // Check if the target square is on the same diagonal, row, or column as the piece
-    if (toRow == pieceRow || toCol == pieceCol ||
-        abs(toRow - pieceRow) == abs(toCol - pieceCol)) {
-    // Determine the direction of movement
-    int rowDirection = (toRow > pieceRow) ? 1 : (toRow < pieceRow) ? -1 : 0;
-    int colDirection = (toCol > pieceCol) ? 1 : (toCol < pieceCol) ? -1 : 0;
-
-    int row = pieceRow + rowDirection;
-    int col = pieceCol + colDirection;
-
-    // Check if there are any pieces obstructing the path
-    while (row != toRow || col != toCol) {
-      if (board->board[row][col].piece != EMPTY) {
-        return false; // Obstruction in the path
-      }
-      row += rowDirection;
-      col += colDirection;
+    int twoRow = row + 2 * direction;
+    if (row == ((C == WHITE) ? 1 : 6) &&
+        board->board[twoRow][col].piece == EMPTY &&
+        (allowed & BB(rowcol2p(twoRow, col)))) {
+      addMove(list, p, rowcol2p(twoRow, col), MOVE_NORMAL);
     }
-
-    return true; // No obstructions, the queen can attack the target square
-  }
-    break;
   }
 
-  case KING: {
-    // Check if the target square is adjacent to the king
-    int rowDiff = abs(toRow - pieceRow);
-    int colDiff = abs(toCol - pieceCol);
-    if ((rowDiff == 1 && colDiff == 0) || (rowDiff == 0 && colDiff == 1) || (rowDiff == 1 && colDiff == 1)) {
-      return true;
-    }
-    break;
+  uint64_t captures = PawnAttacks[C][p] & board->colorBB[them] & allowed;
+  while (captures) {
+    addPawnMove(list, p, pop_lsb(&captures));
   }
 
-  default:
-    break;
+  // En passant removes two pieces from the line of the king, so rather than
+  // reason about pins, look for attackers with the position as it would be
+  int cols_maybe_enpassant[8];
+  colsMayEnPassant(cols_maybe_enpassant, board);
+  if (cols_maybe_enpassant[col] && row == board->lastMove.toRow) {
+    int toCol = col + cols_maybe_enpassant[col];
+    unsigned int to = rowcol2p(toRow, toCol);
+    unsigned int captured = rowcol2p(row, toCol);
+    uint64_t occupied = (board->occupiedBB ^ BB(p) ^ BB(captured)) | BB(to);
+    if (!(attackersTo(board, ci->king, occupied) & board->colorBB[them] & ~BB(captured))) {
+      addMove(list, p, to, MOVE_ENPASSANT);
+    }
   }
-
-  return false; // The piece cannot attack the target square
 }
 
-int locateKing(const Chessboard * board, Color kingColor) {
-  return kingColor == WHITE ? board->WhiteKing : board->BlackKing;
+void generateKnightMoves(const Chessboard* board, const CheckInfo * ci, int row, int col, MoveList * list) {
+  const unsigned int p = rowcol2p(row, col);
+  addMoves(list, p, KnightAttacks[p] & legalTargets(board, ci, p));
 }
 
-bool isKingInCheck(const Chessboard* board, Color kingColor) {
-  unsigned int kL = locateKing(board, kingColor);
-  unsigned int kingRow = p2row(kL);
-  unsigned int kingCol = p2col(kL);
-
-  // Check if any opponent piece can attack the king
-  for (int row = 0; row < 8; row++) {
-    for (int col = 0; col < 8; col++) {
-      Square square = board->board[row][col];
-
-      // Check if the square contains an opponent's piece
-      if (square.color != kingColor && square.piece != EMPTY) {
-        // Check if the opponent's piece can attack the king's position
-        if (canPieceAttackSquare(board, row, col, kingRow, kingCol)) {
-          return true;
-        }
-      }
-    }
-  }
-
-  // If no opponent piece can attack the king, it's not in check
-  return false;
+void generateBishopMoves(const Chessboard* board, const CheckInfo * ci, int row, int col, MoveList * list) {
+  const unsigned int p = rowcol2p(row, col);
+  addMoves(list, p, bishopAttacks(p, board->occupiedBB) & legalTargets(board, ci, p));
 }
 
-bool wouldKingBeInCheck(const Chessboard * board, Color kingColor, int fromRow, int fromCol, int toRow, int toCol, bool enpassant) {
-  Square P = board->board[fromRow][fromCol];
-  Chessboard tempBoard;
-  memcpy(&tempBoard, board, sizeof(Chessboard));
-  tempBoard.board[fromRow][fromCol].piece = EMPTY;
-  tempBoard.board[toRow][toCol].piece = P.piece;
-  tempBoard.board[toRow][toCol].color = P.color;
-  // enpassant is unusual in that the captured pawn is not on the destination square
-  if (enpassant) {
-    tempBoard.board[fromRow][toCol].piece = EMPTY;
-  }
-  return isKingInCheck(&tempBoard, kingColor);
+void generateRookMoves(const Chessboard* board, const CheckInfo * ci, int row, int col, MoveList * list) {
+  const unsigned int p = rowcol2p(row, col);
+  addMoves(list, p, rookAttacks(p, board->occupiedBB) & legalTargets(board, ci, p));
 }
 
-// A piece is 'maybe pinned' if it is pinned though might still be able to move
-// (to capture the pinning piece for example), called 'partially pinned' by wiki
-bool maybePinned(const Chessboard * board, int row, int col) {
-  // corners can't be pinned
-  if ((row == 0 || row == 7) && (col == 0 || col == 7)) {
-    return false;
-  }
-  Chessboard tempBoard;
-  memcpy(&tempBoard, board, sizeof(Chessboard));
-  tempBoard.board[row][col].piece = EMPTY;
-  return isKingInCheck(&tempBoard, board->board[row][col].color);
+void generateQueenMoves(const Chessboard* board, const CheckInfo * ci, int row, int col, MoveList * list) {
+  const unsigned int p = rowcol2p(row, col);
+  addMoves(list, p, queenAttacks(p, board->occupiedBB) & legalTargets(board, ci, p));
 }
 
+int canCastle(const Chessboard* board, Color C) {
+  // 0 castling not possible either side
+  // 1 castling possible kingside but not queenside
+  // 2 castling possible queenside but not kingside
+  // 3 castling possible either side
 
-// Helper function to add a move to the moves array
-void addMove(Move* moves, int* numMoves, int sourceRow, int sourceCol, int toRow, int toCol) {
-  moves[*numMoves].fromRow = sourceRow;
-  moves[*numMoves].fromCol = sourceCol;
-  moves[*numMoves].toRow = toRow;
-  moves[*numMoves].toCol = toCol;
-  (*numMoves)++;
+  unsigned int rights = (C == WHITE) ? board->WhiteMayCastle : board->BlackMayCastle;
+  if (!rights || isKingInCheck(board, C)) {
+    return 0;
+  }
+  const int r = (C == WHITE) ? 0 : 7;
+  if (board->board[r][4].piece != KING || board->board[r][4].color != C) {
+    // should be an error
+    return 0;
+  }
+  bool kingside =
+    (rights & 1) &&
+    board->board[r][7].piece == ROOK && board->board[r][7].color == C &&
+    board->board[r][5].piece == EMPTY &&
+    board->board[r][6].piece == EMPTY;
+  bool queenside =
+    (rights & 2) &&
+    board->board[r][0].piece == ROOK && board->board[r][0].color == C &&
+    board->board[r][1].piece == EMPTY &&
+    board->board[r][2].piece == EMPTY &&
+    board->board[r][3].piece == EMPTY;
+
+  // The king may not pass through or land on an attacked square; the b-file
+  // need only be empty.
+  const Color them = (C == WHITE) ? BLACK : WHITE;
+  if (kingside) {
+    kingside = !isSquareAttacked(board, rowcol2p(r, 5), them) && !isSquareAttacked(board, rowcol2p(r, 6), them);
+  }
+  if (queenside) {
+    queenside = !isSquareAttacked(board, rowcol2p(r, 3), them) && !isSquareAttacked(board, rowcol2p(r, 2), them);
+  }
+  return kingside + 2 * queenside;
 }
 
+void generateKingMoves(const Chessboard* board, const CheckInfo * ci, int row, int col, MoveList * list) {
+  const unsigned int k = ci->king;
+  const Color c = board->board[row][col].color;
+  const Color them = (c == WHITE) ? BLACK : WHITE;
 
-// Function to generate pawn moves
-int generatePawnMoves(const Chessboard* board, int row, int col, Move* moves) {
-  int numMoves = 0;
-
-  Color C = board->board[row][col].color;
-
-  // Determine the color of the pawn
-  bool isWhite = (C == WHITE);
-
-  // Determine the direction of movement based on the pawn's color
-  int direction = isWhite ? 1 : -1;
-
-  // Check if the pawn can move one square forward
-  int toRow = row + direction;
-  int toCol = col;
-
-  if (toRow >= 0 && toRow < 8 && toCol >= 0 && toCol < 8 && board->board[toRow][toCol].piece == EMPTY) {
-    if (!(wouldKingBeInCheck(board, C, row, col, toRow, toCol, false))) {
-      addMove(moves, &numMoves, row, col, toRow, toCol);
-
-      // Check if the pawn can move two squares forward from the starting position
-      if ((isWhite && row == 6) || (!isWhite && row == 1)) {
-        toRow = row + (2 * direction);
-        if (toRow >= 0 && toRow < 8 && board->board[toRow][toCol].piece == EMPTY) {
-          addMove(moves, &numMoves, row, col, toRow, toCol);
-        }
-      }
+  // The king is lifted from the occupancy so that it cannot hide behind
+  // itself from a slider it is stepping away from
+  const uint64_t occupied = board->occupiedBB ^ BB(k);
+  uint64_t targets = KingAttacks[k] & ~(board->colorBB[c]);
+  while (targets) {
+    unsigned int p = pop_lsb(&targets);
+    if (!isSquareAttackedOcc(board, p, them, occupied)) {
+      addMove(list, k, p, MOVE_NORMAL);
     }
   }
-
-  // Check if the pawn can capture diagonally to the left
-  toRow = row + direction;
-  toCol = col - 1;
-  if (toRow >= 0 && toRow < 8 && toCol >= 0 && toCol < 8 && board->board[toRow][toCol].piece != EMPTY && board->board[toRow][toCol].color != board->board[row][col].color) {
-    if (!wouldKingBeInCheck(board, C, row, col, toRow, toCol, false)) {
-      addMove(moves, &numMoves, row, col, toRow, toCol);
-    }
+  // Castling
+  int can_castle = ci->checkers ? 0 : canCastle(board, c);
+  if (can_castle & 1) {
+    addMove(list, k, rowcol2p(row, 6), MOVE_CASTLING);
   }
-
-  // Check if the pawn can capture diagonally to the right
-  toRow = row + direction;
-  toCol = col + 1;
-  if (toRow >= 0 && toRow < 8 && toCol >= 0 && toCol < 8 &&
-      board->board[toRow][toCol].piece != EMPTY &&
-      board->board[toRow][toCol].color != board->board[row][col].color) {
-    if (!wouldKingBeInCheck(board, C, row, col, toRow, toCol, false)) {
-      addMove(moves, &numMoves, row, col, toRow, toCol);
-    }
+  if (can_castle & 2) {
+    addMove(list, k, rowcol2p(row, 2), MOVE_CASTLING);
   }
+}
 
-  int cols_maybe_enpassant[8] = {0};
-  colsMayEnPassant(cols_maybe_enpassant, board);
-  for (int j = 0; j < 8; ++j) {
-    if (cols_maybe_enpassant[j]) {
-      if (!wouldKingBeInCheck(board, C, row, col, toRow, toCol, true)) {
-        addMove(moves, &numMoves, isWhite ? 3 : 4, j, isWhite ? 4 : 3, j + cols_maybe_enpassant[j]);
-      }
+// Moves out of check: the king steps to an unattacked square; or, against a
+// lone checker, another piece captures it or interposes on its ray. A pinned
+// piece can do neither, and in double check only the king may move.
+static int evasions(const Chessboard * board, Color sideToMove, const CheckInfo * ci, MoveList * list) {
+  const unsigned int k = ci->king;
+  generateKingMoves(board, ci, p2row(k), p2col(k), list);
+  if (!ci->evasions) {
+    return list->n;
+  }
+  const uint64_t occupied = board->occupiedBB;
+  const uint64_t * P = board->pieceBB[sideToMove];
+  const uint64_t unpinned = ~(ci->pinned);
+  uint64_t pieces = P[KNIGHT] & unpinned;
+  while (pieces) {
+    unsigned int p = pop_lsb(&pieces);
+    addMoves(list, p, KnightAttacks[p] & ci->evasions);
+  }
+  pieces = (P[BISHOP] | P[QUEEN]) & unpinned;
+  while (pieces) {
+    unsigned int p = pop_lsb(&pieces);
+    addMoves(list, p, bishopAttacks(p, occupied) & ci->evasions);
+  }
+  pieces = (P[ROOK] | P[QUEEN]) & unpinned;
+  while (pieces) {
+    unsigned int p = pop_lsb(&pieces);
+    addMoves(list, p, rookAttacks(p, occupied) & ci->evasions);
+  }
+  // pawns, with their pushes, promotions and en passant, as usual
+  pieces = P[PAWN] & unpinned;
+  while (pieces) {
+    unsigned int p = pop_lsb(&pieces);
+    generatePawnMoves(board, ci, p2row(p), p2col(p), list);
+  }
+  return list->n;
+}
+
+int generateEvasions(const Chessboard * board, Color sideToMove, MoveList * list) {
+  list->n = 0;
+  CheckInfo ci;
+  computeCheckInfo(board, sideToMove, &ci);
+  return evasions(board, sideToMove, &ci, list);
+}
+
+// Only legal moves are generated: the checkers and pins are worked out once
+// and each piece's targets restricted accordingly.
+int generateMoves(const Chessboard* board, Color sideToMove, MoveList * list) {
+  list->n = 0;
+  CheckInfo ci;
+  computeCheckInfo(board, sideToMove, &ci);
+  if (ci.checkers) {
+    return evasions(board, sideToMove, &ci, list);
+  }
+
+  uint64_t own = board->colorBB[sideToMove];
+  while (own) {
+    unsigned int p = pop_lsb(&own);
+    int row = p2row(p);
+    int col = p2col(p);
+    switch (board->board[row][col].piece) {
+    case PAWN:
+      generatePawnMoves(board, &ci, row, col, list);
+      break;
+    case KNIGHT:
+      generateKnightMoves(board, &ci, row, col, list);
+      break;
+    case BISHOP:
+      generateBishopMoves(board, &ci, row, col, list);
+      break;
+    case ROOK:
+      generateRookMoves(board, &ci, row, col, list);
+      break;
+    case QUEEN:
+      generateQueenMoves(board, &ci, row, col, list);
+      break;
+    case KING:
+      generateKingMoves(board, &ci, row, col, list);
+      break;
+    default:
       break;
     }
   }
 
-
-  return numMoves;
+  return list->n;
 }
 
-int generateKnightMoves(const Chessboard* board, int row, int col, Move* moves) {
-  int numMoves = 0;
-  const Color c = board->board[row][col].color;
-
-  // think of a clockface 1,2 4,5, 7,8, 10,11 are the moves in general
-  // const int hrs[8] = {1, 2, 4, 5, 7, 8, 10, 11};
-  const int toRows[8] = {1, 2, 2, 1, -1, -2, -2, -1};
-  const int toCols[8] = {2, 1, -1, -2, -2, -1, 1, 2};
-  for (int h = 0; h < 8; ++h) {
-    int toRow = row + toRows[h];
-    int toCol = col + toCols[h];
-    if (toRow < 0 || toRow >= 8 || toCol < 0 || toCol >= 8) {
-      continue; // outside the board
-    }
-    // same color => not possible
-    if (board->board[toRow][toCol].color == board->board[row][col].color &&
-        board->board[toRow][toCol].piece != EMPTY) {
-      continue;
+// The legal moves in two stages, for searches that try the captures first
+// and may never need the rest: the captures, en passant and promotions, or
+// the other moves. In check the first stage is every evasion and the second
+// empty. As in generateChecks(), pawns and the king are sifted.
+static int generateStage(const Chessboard * board, Color sideToMove, bool captures, MoveList * list) {
+  list->n = 0;
+  CheckInfo ci;
+  computeCheckInfo(board, sideToMove, &ci);
+  if (ci.checkers) {
+    return captures ? evasions(board, sideToMove, &ci, list) : 0;
+  }
+  const uint64_t occupied = board->occupiedBB;
+  const uint64_t stage = captures ? board->colorBB[OPPCOLOR] : ~occupied;
+  uint64_t own = board->colorBB[sideToMove];
+  while (own) {
+    unsigned int p = pop_lsb(&own);
+    int row = p2row(p);
+    int col = p2col(p);
+    uint64_t targets = 0;
+    switch (board->board[row][col].piece) {
+    case PAWN:
+    case KING: {
+      MoveList moves;
+      moves.n = 0;
+      if (board->board[row][col].piece == PAWN) {
+        generatePawnMoves(board, &ci, row, col, &moves);
+      } else {
+        generateKingMoves(board, &ci, row, col, &moves);
+      }
+      for (int i = 0; i < moves.n; ++i) {
+        if (isCaptureOrPromotion(board, moves.moves[i]) == captures) {
+          list->moves[list->n++] = moves.moves[i];
+        }
+      }
     }
-    if (wouldKingBeInCheck(board, c, row, col, toRow, toCol, false)) {
       continue;
+    case KNIGHT:
+      targets = KnightAttacks[p];
+      break;
+    case BISHOP:
+      targets = bishopAttacks(p, occupied);
+      break;
+    case ROOK:
+      targets = rookAttacks(p, occupied);
+      break;
+    case QUEEN:
+      targets = queenAttacks(p, occupied);
+      break;
+    default:
+      break;
     }
-    addMove(moves, &numMoves, row, col, toRow, toCol);
+    addMoves(list, p, targets & legalTargets(board, &ci, p) & stage);
   }
-  return numMoves;
+  return list->n;
 }
 
-int generateBishopMoves(const Chessboard* board, int row, int col, Move* moves) {
-  int numMoves = 0;
-  bool diags_avbl[4] = {1, 1, 1, 1}; // NE, SE, SW, NW
-  const Color c = board->board[row][col].color;
-  bool maybe_pinned = maybePinned(board, row, col);
-  // determine the diagnonals along which the bishop is pinned
-  if (maybe_pinned) {
-    // if the king lies on the same row/col then the bishop is totally pinned
-    unsigned int K_row = p2row(c == WHITE ? board->WhiteKing : board->BlackKing);
-    if (K_row == row) {
-      return 0;
-    }
-    unsigned int K_col = p2col(c == WHITE ? board->WhiteKing : board->BlackKing);
-    if (K_col == col) {
-      return 0;
-    }
+int generateCaptures(const Chessboard * board, Color sideToMove, MoveList * list) {
+  return generateStage(board, sideToMove, true, list);
+}
 
-    // check each diagonal -- if king in check when moving one square along a diagonal
-    // it must be in check along both
-    for (int diag = 0; diag < 4; ++diag) {
-      if (!diags_avbl[diag]) {
-        continue;
-      }
-      int toRow = (diag < 2) ? (row + 1) : (row - 1);
-      int toCol = (diag == 2 || diag == 3) ? (col - 1) : (col + 1);
-      if (toRow >= 8 || toRow < 0 || toCol >= 8 || toCol < 0) {
-        continue;
-      }
-      if (board->board[toRow][toCol].piece != EMPTY && board->board[toRow][toCol].color == c) {
-        diags_avbl[diag] = 0;
-        continue;
-      }
+int generateQuiets(const Chessboard * board, Color sideToMove, MoveList * list) {
+  return generateStage(board, sideToMove, false, list);
+}
 
-      Chessboard tempBoard;
-      memcpy(&tempBoard, board, sizeof(Chessboard));
-      tempBoard.board[toRow][toCol].piece = BISHOP;
-      tempBoard.board[toRow][toCol].color = c;
-      tempBoard.board[row][col].piece = EMPTY;
-
-      if (board->board[toRow][toCol].piece != EMPTY) {
-        // Capture the adjacent piece
-        if (isKingInCheck(&tempBoard, c)) {
-          diags_avbl[diag] = 0;
-          diags_avbl[(diag + 2) & 3] = 0; // opposite direction must be unavailable too
-        } else {
-          // Add the move to the array here because we immediately disqualify
-          // the diagnoal
-          addMove(moves, &numMoves, row, col, toRow, toCol);
-          diags_avbl[diag] = 0; //
-        }
-      } else {
-        if (isKingInCheck(&tempBoard, c)) {
-          diags_avbl[diag] = 0;
-          diags_avbl[(diag + 2) & 3] = 0; // opposite direction must be unavailable too
-        } else {
-          // do nothing, we will add the move in the main loop
-        }
-      }
-    }
+// Would m, a legal move for side, check the enemy king? Worked out from the
+// bitboards as they would be, without making the move: either the piece
+// attacks the king from where it lands (for castling, the rook), or its
+// leaving opens a line from one of our sliders.
+bool givesCheck(const Chessboard * board, Color side, Move16 m) {
+  const unsigned int ek = locateKing(board, side == WHITE ? BLACK : WHITE);
+  const unsigned int from = MOVE16_FROM(m);
+  unsigned int to = MOVE16_TO(m);
+  Piece P = board->board[p2row(from)][p2col(from)].piece;
+  uint64_t moved = BB(from);
+  uint64_t occupied = (board->occupiedBB ^ BB(from)) | BB(to);
+  switch (MOVE16_KIND(m)) {
+  case MOVE_PROMOTION:
+    P = MOVE16_PROMOTED(m);
+    break;
+  case MOVE_ENPASSANT:
+    occupied ^= BB(rowcol2p(p2row(from), p2col(to)));
+    break;
+  case MOVE_CASTLING: {
+    const unsigned int rookFrom = to > from ? from + 3 : from - 4;
+    to = to > from ? from + 1 : from - 1;
+    P = ROOK;
+    moved |= BB(rookFrom);
+    occupied = (occupied ^ BB(rookFrom)) | BB(to);
   }
-  for (int d = 1; d < 8; ++d) {
-    // first test whether we have reached beyond the edges of the board
-    if (row + d >= 8) {
-      diags_avbl[0] = 0; // NE
-      diags_avbl[1] = 0; // SE
-    }
-    if (row - d < 0) {
-      diags_avbl[2] = 0; // SW
-      diags_avbl[3] = 0; // NW
-    }
-    if (col + d >= 8) {
-      diags_avbl[0] = 0; // NE
-      diags_avbl[3] = 0; // NW
-    }
-    if (col - d < 0) {
-      diags_avbl[1] = 0; // SE
-      diags_avbl[2] = 0; // SW
-    }
-    // Now check each diagonal; a diag is unavbl once a piece is in the way
-    // if the blocking piece is of the opposite color, it can be captured so
-    // counts as an extra move, before disqualifying the diagonal.
-
-    // NE
-    if (diags_avbl[0]) {
-      if (board->board[row + d][col + d].piece != EMPTY) {
-        if (board->board[row + d][col + d].color != c) {
-          addMove(moves, &numMoves, row, col, row + d, col + d);
-        }
-        diags_avbl[0] = 0;
-        continue;
-      }
-      addMove(moves, &numMoves, row, col, row + d, col + d);
-      continue;
-    }
-    // SE
-    if (diags_avbl[1]) {
-      if (board->board[row - d][col + d].piece != EMPTY) {
-        if (board->board[row - d][col + d].color != c) {
-          addMove(moves, &numMoves, row, col, row - d, col + d);
-        }
-        diags_avbl[1] = 0;
-        continue;
-      }
-      addMove(moves, &numMoves, row, col, row - d, col + d);
-      continue;
-    }
-    // SW
-    if (diags_avbl[2]) {
-      if (board->board[row - d][col - d].piece != EMPTY) {
-        if (board->board[row - d][col - d].color != c) {
-          addMove(moves, &numMoves, row, col, row - d, col - d);
-        }
-        diags_avbl[2] = 0;
-        continue;
-      }
-      addMove(moves, &numMoves, row, col, row - d, col - d);
-      continue;
-    }
-    // NW
-    if (diags_avbl[3]) {
-      if (board->board[row + d][col - d].piece != EMPTY) {
-        if (board->board[row + d][col - d].color != c) {
-          addMove(moves, &numMoves, row, col, row + d, col - d);
-        }
-        diags_avbl[3] = 0;
-        continue;
-      }
-      addMove(moves, &numMoves, row, col, row + d, col - d);
-      continue;
-    }
-  }
-  return numMoves;
-}
-
-int generateRookMoves(const Chessboard* board, int row, int col, Move* moves) {
-  int numMoves = 0;
-  bool dirs_avbl[4] = {1, 1, 1, 1}; // N, S, E, W
-  int dirs_oppos[4] = {1, 0, 3, 2};
-  int toRows[4] = {1, -1, 0, 0};
-  int toCols[4] = {0, 0, 1, -1};
-
-  const Color c = board->board[row][col].color;
-  bool maybe_pinned = maybePinned(board, row, col);
-  bool in_check = isKingInCheck(board, c);
-
-  if (in_check) {
-    for (int dir = 0; dir < 4; ++dir) {
-      for (int d = 1; d < 8; ++d) {
-        if (!dirs_avbl[dir]) {
-          break;
-        }
-        int toRow = row + d * toRows[dir];
-        int toCol = col + d * toCols[dir];
-
-        if (toRow < 0 || toRow >= 8 || toCol < 0 || toCol >= 8) {
-          dirs_avbl[dir] = 0;
-          break;
-        }
-        if (board->board[toRow][toCol].piece != EMPTY) {
-          dirs_avbl[dir] = 0;
-          if (board->board[toRow][toCol].color == c) {
-            break;
-          }
-        }
-        if (wouldKingBeInCheck(board, c, row, col, toRow, toCol, false)) {
-          continue;
-        } else {
-          addMove(moves, &numMoves, row, col, toRow, toCol);
-        }
-      }
-    }
-    return numMoves;
-  }
-
-  if (maybe_pinned) {
-    // if the king and the rook lie on the same diagonal then it is totally pinned
-    unsigned int itsKing = (c == WHITE) ? board->WhiteKing : board->BlackKing;
-    if (liesOnSameDiag(itsKing, (row << 3) + col)) {
-      return 0;
-    }
-    unsigned int K_row = itsKing >> 3;
-    if (K_row == row) {
-      dirs_avbl[0] = 0;
-      dirs_avbl[1] = 0;
-    } else {
-      dirs_avbl[2] = 0;
-      dirs_avbl[3] = 0;
-    }
-    for (int dir = 0; dir < 4; ++dir) {
-      if (!dirs_avbl[dir]) {
-        continue;
-      }
-      int toRow = row + (dir == 3) - 2 * (dir == 4);
-      int toCol = col + (dir == 0) - 2 * (dir == 1);
-      if (toRow < 0 || toRow >= 8 || toCol < 0 || toCol >= 8) {
-        continue;
-      }
-      if (board->board[toRow][toCol].piece != EMPTY && board->board[toRow][toCol].color == c) {
-        dirs_avbl[dir] = 0;
-        continue;
-      }
-      Chessboard tempBoard;
-      memcpy(&tempBoard, board, sizeof(Chessboard));
-      tempBoard.board[toRow][toCol].piece = ROOK;
-      tempBoard.board[toRow][toCol].color = c;
-      tempBoard.board[row][col].piece = EMPTY;
-
-      if (board->board[toRow][toCol].piece != EMPTY) {
-        // Capture the adjacent piece
-        if (isKingInCheck(&tempBoard, c)) {
-          dirs_avbl[dir] = 0;
-          dirs_avbl[dirs_oppos[dir]] = 0;
-        } else {
-          addMove(moves, &numMoves, row, col, toRow, toCol);
-          dirs_avbl[dir] = 0;
-        }
-      } else {
-        if (!isKingInCheck(&tempBoard, c)) {
-          addMove(moves, &numMoves, row, col, toRow, toCol);
-        }
-      }
-    }
-
-
-  }
-  if (dirs_avbl[0]) {
-    for (int d = 1; d < 8; ++d) {
-      if (col + d >= 8) {
-        break;
-      }
-      int toCol = col + d;
-      int toRow = row;
-      Chessboard tempBoard;
-      memcpy(&tempBoard, board, sizeof(Chessboard));
-      tempBoard.board[toRow][toCol].piece = ROOK;
-      tempBoard.board[toRow][toCol].color = c;
-      tempBoard.board[row][col].piece = EMPTY;
-      if (!isKingInCheck(&tempBoard, c)) {
-        addMove(moves, &numMoves, row, col, row, col + d);
-      }
-      if (board->board[row][toCol].piece != EMPTY) {
-        break;
-      }
-    }
-  }
-  if (dirs_avbl[1]) {
-    for (int d = 1; d < 8; ++d) {
-      if (col - d < 0) {
-        break;
-      }
-      int toCol = col - d;
-      int toRow = row;
-      Chessboard tempBoard;
-      memcpy(&tempBoard, board, sizeof(Chessboard));
-      tempBoard.board[toRow][toCol].piece = ROOK;
-      tempBoard.board[toRow][toCol].color = c;
-      tempBoard.board[row][col].piece = EMPTY;
-      if (!isKingInCheck(&tempBoard, c)) {
-        addMove(moves, &numMoves, row, col, row, col + d);
-      }
-      if (board->board[row][toCol].piece != EMPTY) {
-        break;
-      }
-    }
-  }
-  if (dirs_avbl[2]) {
-    for (int d = 1; d < 8; ++d) {
-      if (row + d >= 8) {
-        break;
-      }
-      int toCol = col;
-      int toRow = row + d;
-      Chessboard tempBoard;
-      memcpy(&tempBoard, board, sizeof(Chessboard));
-      tempBoard.board[toRow][toCol].piece = ROOK;
-      tempBoard.board[toRow][toCol].color = c;
-      tempBoard.board[row][col].piece = EMPTY;
-      if (!isKingInCheck(&tempBoard, c)) {
-        addMove(moves, &numMoves, row, col, row, col + d);
-      }
-      if (board->board[row][toCol].piece != EMPTY) {
-        break;
-      }
-    }
-  }
-  if (dirs_avbl[3]) {
-    for (int d = 1; d < 8; ++d) {
-      if (row - d < 0) {
-        break;
-      }
-      int toCol = col;
-      int toRow = row - d;
-      Chessboard tempBoard;
-      memcpy(&tempBoard, board, sizeof(Chessboard));
-      tempBoard.board[toRow][toCol].piece = ROOK;
-      tempBoard.board[toRow][toCol].color = c;
-      tempBoard.board[row][col].piece = EMPTY;
-      if (!isKingInCheck(&tempBoard, c)) {
-        addMove(moves, &numMoves, row, col, row, col + d);
-      }
-      if (board->board[row][toCol].piece != EMPTY) {
-        break;
-      }
-    }
-  }
-
-  return numMoves;
-}
-
-int generateQueenMoves(const Chessboard* board, int row, int col, Move* moves) {
-  int numMoves = 0;
-  const Color c = board->board[row][col].color;
-  bool maybe_pinned = maybePinned(board, row, col);
-
-  // N clockwise to NW
-  bool dirs_avbl[8] = {1, 1, 1, 1, 1, 1, 1, 1};
-  int toCols[8] = {0, 1, 1, 1, 0, -1, -1, -1};
-  int toRows[8] = {1, 1, 0, -1, -1, -1, 0, 1};
-
-  if (maybe_pinned) {
-    // unsigned int K_row = p2row(c == WHITE ? board->WhiteKing : board->BlackKing);
-    for (int dir = 0; dir < 8; ++dir) {
-      if (!dirs_avbl[dir]) {
-        continue;
-      }
-      int toRow = row + toRows[dir];
-      int toCol = col + toCols[dir];
-      if (toRow < 0 || toRow >= 8 || toCol < 0 || toCol >= 8) {
-        continue;
-      }
-      if (board->board[toRow][toCol].piece != EMPTY && board->board[toRow][toCol].color == c) {
-        dirs_avbl[dir] = 0;
-        continue;
-      }
-      Chessboard tempBoard;
-      memcpy(&tempBoard, board, sizeof(Chessboard));
-      tempBoard.board[toRow][toCol].piece = QUEEN;
-      tempBoard.board[toRow][toCol].color = c;
-      tempBoard.board[row][col].piece = EMPTY;
-      if (board->board[toRow][toCol].piece != EMPTY) {
-        if (isKingInCheck(board, c)) {
-          dirs_avbl[dir] = 0;
-          dirs_avbl[(dir + 4) & 7] = 0;
-        } else {
-          addMove(moves, &numMoves, row, col, toRow, toCol);
-          dirs_avbl[dir] = 0;
-        }
-      } else {
-        if (isKingInCheck(board, c)) {
-          dirs_avbl[dir] = 0;
-          dirs_avbl[(dir + 4) & 7] = 0;
-        }
-      }
-    }
-  }
-  for (int dir = 0; dir < 8; ++dir) {
-    if (!dirs_avbl[dir]) {
-      continue;
-    }
-    for (int d = 0; d < 8; ++d) {
-      int toRow = row + d * toRows[dir];
-      int toCol = col + d * toCols[dir];
-      if (toRow < 0 || toRow >= 8 || toCol < 0 || toCol >= 8) {
-        break;
-      }
-      if (board->board[toRow][toCol].piece == EMPTY) {
-        addMove(moves, &numMoves, row, col, toRow, toCol);
-        continue;
-      }
-      if (board->board[toRow][toCol].color == c) {
-        dirs_avbl[dir] = 0;
-        break;
-      }
-      addMove(moves, &numMoves, row, col, toRow, toCol);
-      break;
-    }
-  }
-  return numMoves;
-}
-
-int canCastle(const Chessboard* board, Color C) {
-  // 0 castling not possible either side
-  // 1 castling possible kingside but not queenside
-  // 2 castling possible queenside but not kingside
-  // 3 castling possible either side
-
-  if (isKingInCheck(board, C)) {
-    return 0;
-  }
-  bool kingside = true;
-  bool queenside = true;
-  if (C == WHITE) {
-    if (!(board->WhiteMayCastle)) {
-      return 0;
-    }
-    if (board->board[0][0].piece != ROOK || board->board[0][0].color != C) {
-      queenside = false;
-    }
-    if (board->board[0][7].piece != ROOK || board->board[0][7].color != C) {
-      kingside = false;
-    }
-
-
-    // check obstructions
-    // loop through bottom row, but not the rooks
-    for (int c = 1; c < 7; ++c) {
-      if (c == 4) {
-        if (board->board[0][4].piece != KING || board->board[0][4].color != C) {
-          // should be an error
-          return 0;
-        }
-        continue; // king
-      }
-      // don't check each column if already determined to be impossible
-      if (c < 4 && !queenside) {
-        continue;
-      }
-      if (c > 4 && !kingside) {
-        break;
-      }
-      if (board->board[0][c].piece != EMPTY) {
-        if (c < 4) {
-          queenside = false;
-        } else {
-          kingside = false;
-        }
-        continue;
-      }
-      if (c == 1) {
-        // queenside possible if in check on 1
-        continue;
-      }
-      Chessboard tempBoard;
-      memcpy(&tempBoard, board, sizeof(Chessboard));
-      tempBoard.board[0][c].piece = KING;
-      tempBoard.board[0][c].color = C;
-      tempBoard.board[0][4].piece = EMPTY;
-      if (isKingInCheck(&tempBoard, C)) {
-        if (c < 4) {
-          queenside = false;
-        } else {
-          kingside = false;
-        }
-      }
-    }
-
-
-  } else {
-    if (!(board->BlackMayCastle)) {
-      return 0;
-    }
-    if (board->board[7][0].piece != ROOK || board->board[7][0].color != C) {
-      queenside = false;
-    }
-    if (board->board[7][7].piece != ROOK || board->board[7][7].color != C) {
-      kingside = false;
-    }
-
-
-    // check obstructions
-    // loop through bottom row, but not the castles
-    for (int c = 1; c < 7; ++c) {
-      if (c == 4) {
-        if (board->board[7][4].piece != KING || board->board[7][4].color != C) {
-          // should be an error
-          return 0;
-        }
-        continue; // king
-      }
-      // don't check each column if already determined to be impossible
-      if (c < 4 && !queenside) {
-        continue;
-      }
-      if (c > 4 && !kingside) {
-        break;
-      }
-      if (board->board[7][c].piece != EMPTY) {
-        if (c < 4) {
-          queenside = false;
-        } else {
-          kingside = false;
-        }
-        continue;
-      }
-      if (c == 1) {
-        continue;
-      }
-      Chessboard tempBoard;
-      memcpy(&tempBoard, board, sizeof(Chessboard));
-      tempBoard.board[7][c].piece = KING;
-      tempBoard.board[7][c].color = C;
-      tempBoard.board[7][4].piece = EMPTY;
-      if (isKingInCheck(&tempBoard, C)) {
-        if (c < 4) {
-          queenside = false;
-        } else {
-          kingside = false;
-        }
-      }
-    }
-  }
-  if (kingside && queenside) {
-    return 3;
-  }
-  if (kingside) {
-    return 1;
-  }
-  if (queenside) {
-    return 2;
+    break;
+  default:
+    break;
   }
-  return 0;
-}
 
-int generateKingMoves(const Chessboard* board, int row, int col, Move* moves) {
-  int numMoves = 0;
-  const Color c = board->board[row][col].color;
-
-  // N clockwise to NW
-  int toCols[8] = {0, 1, 1, 1, 0, -1, -1, -1};
-  int toRows[8] = {1, 1, 0, -1, -1, -1, 0, 1};
-
-  for (int dir = 0; dir < 8; ++dir) {
-    int toRow = row + toRows[dir];
-    int toCol = col + toCols[dir];
-    if (toRow < 0 || toRow >= 8 || toCol < 0 || toCol >= 8) {
-      continue;
-    }
-    if (board->board[toRow][toCol].piece != EMPTY && board->board[toRow][toCol].color == c) {
-      continue;
-    }
-    Chessboard tempBoard;
-    memcpy(&tempBoard, board, sizeof(Chessboard));
-    tempBoard.board[toRow][toCol].piece = KING;
-    tempBoard.board[toRow][toCol].color = c;
-    tempBoard.board[row][col].piece = EMPTY;
-    if (c == WHITE) {
-      tempBoard.WhiteKing = rowcol2p(toRow, toCol);
-    } else {
-      tempBoard.BlackKing = rowcol2p(toRow, toCol);
-    }
-    if (isKingInCheck(&tempBoard, c)) {
-      continue;
-    }
-    addMove(moves, &numMoves, row, col, toRow, toCol);
-  }
-  // Castling
-  int can_castle = canCastle(board, c);
-  switch(can_castle) {
-  case 0:
+  uint64_t attacks = 0;
+  switch (P) {
+  case PAWN:
+    attacks = PawnAttacks[side][to];
     break;
-  case 1:
-    addMove(moves, &numMoves, row, col, row, 6);
+  case KNIGHT:
+    attacks = KnightAttacks[to];
     break;
-  case 2:
-    addMove(moves, &numMoves, row, col, row, 2);
+  case BISHOP:
+    attacks = bishopAttacks(to, occupied);
     break;
-  default: {
-      addMove(moves, &numMoves,  row, col, row, 6);
-      addMove(moves, &numMoves,  row, col, row, 2);
-    }
-  }
-  return numMoves;
-}
-
-int generateMoves(const Chessboard* board, Color sideToMove, Move* moves) {
-  int numMoves = 0;
-
-  for (int row = 0; row < 8; row++) {
-    for (int col = 0; col < 8; col++) {
-      Square square = board->board[row][col];
-      if (square.piece != EMPTY && square.color == sideToMove) {
-        switch (square.piece) {
-        case PAWN:
-          numMoves += generatePawnMoves(board, row, col, moves + numMoves);
-          break;
-        case KNIGHT:
-          numMoves += generateKnightMoves(board, row, col, moves + numMoves);
-          break;
-        case BISHOP:
-          numMoves += generateBishopMoves(board, row, col, moves + numMoves);
-          break;
-        case ROOK:
-          numMoves += generateRookMoves(board, row, col, moves + numMoves);
-          break;
-        case QUEEN:
-          numMoves += generateQueenMoves(board, row, col, moves + numMoves);
-          break;
-        case KING:
-          numMoves += generateKingMoves(board, row, col, moves + numMoves);
-          break;
-        default:
-          break;
-        }
-      }
-    }
-  }
-
-  return numMoves;
-}
-
-bool isCheckmate(const Chessboard* board, Color sideToMove) {
-  // Generate all possible moves for the side to move
-  Move possibleMoves[MAX_MOVES];
-  int numPossibleMoves = generateMoves(board, sideToMove, possibleMoves);
-  for (int j = 0; j < numPossibleMoves; ++j) {
-    // print_the_piece(possibleMoves[j].toPiece);
-    // const char * letters = "abcdefgh";
-    // Rprintf(": %c%d->%c%d\n",
-    //         letters[possibleMoves[j].fromCol], possibleMoves[j].fromRow + 1,
-    //         letters[possibleMoves[j].toCol], possibleMoves[j].toRow + 1);
-
-  }
-
-  return numPossibleMoves == 0 && isKingInCheck(board, sideToMove);
-}
-
-int isntValidBoard(const Chessboard * board, Color colorToMove) {
-  // 0 is valid
-  // 1 white king absent
-  // 2 black king absent
-  // 3 both kings absent
-  // 4 white king does not match duplicate record
-  // 5 black king does not match duplicate record
-  // 6 other king is in check
-  int kingRows[2] = {-1, -1};
-  int kingCols[2] = {-1, -1};
-  bool white_king_set = false;
-  bool black_king_set = false;
-  if (board->board[0][4].piece == KING && board->board[0][4].color == WHITE) {
-    kingRows[0] = 0;
-    kingCols[0] = 4;
-    white_king_set = true;
-  }
-  if (board->board[7][4].piece == KING && board->board[7][4].color == BLACK) {
-    kingRows[1] = 7;
-    kingCols[1] = 4;
-    black_king_set = true;
-  }
-  if (!white_king_set) {
-    for (int r = 0; r < 8; ++r) {
-      for (int c = 0; c < 8; ++c) {
-        if (board->board[r][c].piece == KING && board->board[r][c].color == WHITE) {
-          kingRows[0] = r;
-          kingCols[0] = c;
-        }
-      }
-    }
-  }
-  if (!black_king_set) {
-    for (int r = 0; r < 8; ++r) {
-      for (int c = 0; c < 8; ++c) {
-        if (board->board[r][c].piece == KING && board->board[r][c].color == BLACK) {
-          kingRows[1] = r;
-          kingCols[1] = c;
-        }
-      }
-    }
-  }
-  if (kingRows[0] < 0 || kingRows[1] < 0 || kingCols[0] < 0 || kingCols[1] < 0) {
-    // one or both kings are absent
-    return (kingRows[0] < 0 && kingRows[1] < 0) ? 3 : (kingRows[0] < 0 ? 1 : 2);
-  }
-  if (rowcol2p(kingRows[0], kingCols[0]) != board->WhiteKing) {
-    return 4;
-  }
-  if (rowcol2p(kingRows[1], kingCols[1]) != board->BlackKing) {
-    return 5;
-  }
-
-  if (isKingInCheck(board, colorToMove == WHITE ? BLACK : WHITE)) {
-    return 6;
-  }
-
-
-
-
-  return 0;
-}
-
-// positions only, not algebraic notation
-unsigned int string2p(const char * x) {
-  const char * letters = "abcdefgh";
-
-  if (isupper(x[0])) {
-    if (strlen(x) < 3) {
-      error("strlen(x = %s) < 3", x);
-    }
-    for (int c = 0; c < 8; ++c) {
-      if (x[1] == letters[c]) {
-
-        unsigned int oooo =  rowcol2p(x[2] - '1', c);
-        return oooo;
-      }
-    }
-  } else {
-    for (int c = 0; c < 8; ++c) {
-      if (x[0] == letters[c]) {
-        return rowcol2p(x[1] - '1', c);
-      }
-    }
-  }
-  error("(string2p)Could not determine position from string '%s'", x);
-}
-
-Piece string2Piece(const char * x) {
-  switch(x[0]) {
-  case 'K':
-    return KING;
-  case 'Q':
-    return QUEEN;
-  case 'B':
-    return BISHOP;
-  case 'N':
-    return KNIGHT;
-  case 'R':
-    return ROOK;
-  default:
-    return PAWN;
-  }
-}
-
-unsigned int PawnBoard2p(const Color C, const Chessboard * board, unsigned int to_p, int fromRow, int fromCol, bool capture) {
-  int to_row = p2row(to_p);
-  int to_col = p2col(to_p);
-  if (fromRow > 0 && fromCol >= 0) {
-    return rowcol2p(fromRow, fromCol);
-  }
-  switch(C) {
-  case WHITE:
-    switch(to_row) {
-    case 2:
-      if (capture) {
-        if (fromRow >= 0) {
-          // just need to determine column, which will be the only one with a pawn
-          if (to_col > 0 &&
-              board->board[fromRow][to_col - 1].piece == PAWN &&
-              board->board[fromRow][to_col - 1].color == WHITE) {
-            return rowcol2p(fromRow, to_col - 1);
-          }
-          if (to_col < 7 &&
-              board->board[fromRow][to_col + 1].piece == PAWN &&
-              board->board[fromRow][to_col + 1].color == WHITE) {
-            return rowcol2p(fromRow, to_col + 1);
-          }
-        } else {
-          // column is determined
-          return rowcol2p(to_row - 1, fromRow);
-        }
-      } else {
-
-      }
-    }
+  case ROOK:
+    attacks = rookAttacks(to, occupied);
     break;
-  case BLACK:
-    return 0;
-  }
-  return 55;
-}
-
-unsigned int PieceBoard2p(const Piece P, const Color C, const Chessboard * board, unsigned int to_p) {
-
-  int n = 0;
-  uint16_t o[62] = {0};
-
-  for (int r = 0; r < 8; ++r) {
-    for (int c = 0; c < 8; ++c) {
-      if (board->board[r][c].piece == P &&
-          board->board[r][c].color == C) {
-        o[n++] = rowcol2p(r, c);
-      }
-    }
-  }
-  if (n == 0) {
-    error("Could not find piece on board.");
-  }
-  if (n == 1) {
-    return o[0];
-  }
-  int to_row = p2row(to_p);
-  int to_col = p2col(to_p);
-  for (int k = 0; k < n; ++k) {
-    unsigned int from_p = o[k];
-    int from_row = p2row(from_p);
-    int from_col = p2col(from_p);
-    if (canPieceAttackSquare(board, from_row, from_col, to_row, to_col)) {
-      return from_p;
-    }
-
-  }
-
-
-  if (P == BISHOP) {
-    if (liesOnSameDiag(to_p, o[0])) {
-
-    }
-  }
-  // error("Unable to determine Piece2Board.");
-
-  return 55;
-
-}
-
-bool is_1to8(char x) {
-  return x >= '1' && x <= '8';
-}
-
-bool is_abcdefgh(char x) {
-  return x >= 'a' && x <= 'h';
-}
-
-bool is_algebraic_position(char x) {
-  return is_1to8(x) || is_abcdefgh(x);
-}
-
-bool is_terminal_char(char x) {
-  return x == '+' || x == '!' || x == '?' || x == '#' || x == '=';
-}
-
-void validate_algebraic_string(const char * x) {
-  int j = 0;
-  if (isupper(x[0])) {
-    if (x[0] != 'R' && x[0] != 'N' && x[0] != 'B' && x[0] != 'Q' && x[0] != 'K') {
-      error("First char of x was uppercase but not a valid piecename.");
-    }
-    j = 1;
-  } else {
-    if (is_abcdefgh(x[1])) {
-      if (abs(x[0] - x[1]) > 1) {
-        error("Pawn move %x appears to be a movement beyond range: %c -> %c", x, x[0], x[1]);
-      }
-    } else if (x[1] <= '1' || x[1] >= '8') {
-      // pawn cannot move to outer rows
-      error("Invalid row for pawn move: %s", x);
-    }
-  }
-  if (!is_algebraic_position(x[j++])) {
-    error("First character not a position.");
-  }
-
-  while (x[j] != '\0') {
-    if (!is_algebraic_position(x[j])) {
-      if (is_terminal_char(x[j]))  {
-        return;
-      }
-      error("Invalid string '%s' at position %d.", x, j);
-    }
-    ++j;
-    if (x[j] == 'x') {
-      ++j;
-      break;
-    }
-  }
-  while (x[j] != '\0') {
-    if (!is_algebraic_position(x[j])) {
-      if (is_terminal_char(x[j]))  {
-        return;
-      }
-      error("Invalid string '%s' at position %d.", x, j);
-    }
-    ++j;
-  }
-
-
-}
-
-Move string2move(const char * x, int n, const Chessboard * board, Color sideToMove) {
-  Move M;
-  if (x[0] == 'O' && x[1] == '-' && x[2] == 'O') {
-    M.fromRow = (sideToMove == WHITE) ? 0 : 7;
-    M.fromCol = 4;
-    M.toRow = M.fromRow;
-    M.toCol = (n == 3) ? 7 : 0;
-
-    if (board->board[M.fromRow][M.fromCol].piece != KING) {
-      error("move was '%s' for %s but King not in starting position", x, color2str);
-    }
-    if (board->board[M.toRow][M.toCol].piece != ROOK) {
-      error("move was '%s' for %s but Rook not in starting position", x, color2str);
-    }
-
-    M.toPiece = KING;
-    return M;
-  }
-
-  validate_algebraic_string(x);
-  // unsigned int p = string2p(x);
-
-
-  switch(n) {
-  case 2: {
-    M.toRow = x[1] - '1';
-    M.toCol = x[0] - 'a';
-    M.fromCol = M.toCol;
-    M.toPiece = PAWN;
-    // pawn has simply moved
-    if (sideToMove == WHITE) {
-      if (board->board[M.toRow - 1][M.toCol].piece == PAWN &&
-          board->board[M.toRow - 1][M.toCol].color == WHITE) {
-        M.fromRow = M.toRow - 1;
-        return M;
-      }
-      if (board->board[M.toRow - 2][M.toCol].piece == PAWN &&
-          board->board[M.toRow - 2][M.toCol].color == WHITE &&
-          board->board[M.toRow - 1][M.toCol].piece == EMPTY) {
-        M.fromRow = M.toRow - 2;
-        return M;
-      }
-      error("String '%s' appears to be a pawn move but not valid.", x);
-
-    } else {
-      if (board->board[M.toRow + 1][M.toCol].piece == PAWN &&
-          board->board[M.toRow + 1][M.toCol].color == BLACK) {
-        M.fromRow = M.toRow + 1;
-        return M;
-      }
-      if (board->board[M.toRow + 2][M.toCol].piece == PAWN &&
-          board->board[M.toRow + 2][M.toCol].color == BLACK &&
-          board->board[M.toRow + 1][M.toCol].piece == EMPTY) {
-        M.fromRow = M.toRow + 2;
-        return M;
-      }
-      error("String '%s' appears to be a pawn move but not valid.", x);
-    }
-  }
-  case 3:
-    if (!isupper(x[0])) {
-      // possibly capture
-      if (is_abcdefgh(x[0]) && is_abcdefgh(x[1]) && is_1to8(x[2])) {
-        Rprintf("\n %s \n", x);
-        M.toPiece = PAWN;
-        M.fromCol = x[0] - 'a';
-        M.toCol = x[1] - 'a';
-        M.toRow = x[2] - '0';
-        M.fromRow = sideToMove == WHITE ? M.toRow - 1 : M.toRow + 1;
-        return M;
-      }
-      // should be a pawn something (check, mate, blunder etc)
-      if (!is_terminal_char(x[2]))  {
-        error("String '%s' was length 3 but did not have expected terminal char", x);
-      }
-      M.toPiece = PAWN;
-      M.toRow = x[1] - '1';
-      M.toCol = x[0] - 'a';
-      M.fromCol = M.toCol;
-      if (x[2] == '+' || x[2] == '#') {
-        // check king in Check
-        bool king_in_check = false;
-        int lh_target = M.toCol - 1;
-        int rh_target = M.toCol + 1;
-        int rr_target = (sideToMove == WHITE) ? (M.toRow + 1) : (M.toRow - 1);
-        if (lh_target >= 0 &&
-            board->board[rr_target][lh_target].piece == KING &&
-            board->board[rr_target][lh_target].color != sideToMove) {
-          king_in_check = true;
-        }
-        if (rh_target <= 7 &&
-            board->board[rr_target][lh_target].piece == KING &&
-            board->board[rr_target][lh_target].color != sideToMove) {
-          king_in_check = true;
-        }
-        //
-        if (!king_in_check) {
-          Chessboard tempBoard;
-          memcpy(&tempBoard, board, sizeof(Chessboard));
-          tempBoard.board[M.toRow][M.toCol].piece = PAWN;
-          tempBoard.board[M.toRow][M.toCol].color = sideToMove;
-
-
-          if (board->board[M.toCol][M.toRow - 1].piece == PAWN &&
-              board->board[M.toCol][M.toRow - 1].color == sideToMove)  {
-            tempBoard.board[M.toCol][M.toRow - 1].piece = EMPTY;
-            if (isKingInCheck(&tempBoard, OPPCOLOR)) {
-              king_in_check = true;
-            }
-          } else if (board->board[M.toCol][M.toRow - 2].piece == PAWN &&
-            board->board[M.toCol][M.toRow - 2].color == sideToMove &&
-            board->board[M.toCol][M.toRow - 1].piece == EMPTY)  {
-            tempBoard.board[M.toCol][M.toRow - 2].piece = PAWN;
-            if (isKingInCheck(&tempBoard, OPPCOLOR)) {
-              king_in_check = true;
-            }
-          } else {
-            error("Unexpected move '%s'.", x);
-          }
-        }
-      }
-
-      if (sideToMove == WHITE) {
-        if (board->board[M.toCol][M.toRow - 1].piece == PAWN &&
-            board->board[M.toCol][M.toRow - 1].color == WHITE) {
-          M.fromRow = M.toRow - 1;
-          return M;
-        }
-        if (board->board[M.toCol][M.toRow - 2].piece == PAWN &&
-            board->board[M.toCol][M.toRow - 2].color == WHITE &&
-            board->board[M.toCol][M.toRow - 1].piece == EMPTY) {
-          M.fromRow = M.toRow - 2;
-          return M;
-        }
-        error("String '%s' appears to be a pawn move but not valid.", x);
+  case QUEEN:
+    attacks = queenAttacks(to, occupied);
+    break;
+  default:
+    break;
+  }
+  if (attacks & BB(ek)) {
+    return true;
+  }
+  const uint64_t * S = board->pieceBB[side];
+  return
+    ((bishopAttacks(ek, occupied) & (S[BISHOP] | S[QUEEN])) |
+     (rookAttacks(ek, occupied) & (S[ROOK] | S[QUEEN]))) & ~moved;
+}
 
+// Only the legal moves that give check, direct or discovered. Pieces find
+// them as masks: the squares from which they would attack the enemy king,
+// or anywhere off the line if they stand between it and one of our sliders.
+// Pawns and the king, whose moves have too many special cases, are
+// generated in full and sifted by givesCheck().
+int generateChecks(const Chessboard * board, Color sideToMove, MoveList * list) {
+  list->n = 0;
+  CheckInfo ci;
+  computeCheckInfo(board, sideToMove, &ci);
+  const Color them = OPPCOLOR;
+  const unsigned int ek = locateKing(board, them);
+  const uint64_t occupied = board->occupiedBB;
+
+  // Squares from which each piece would check. A piece can't be standing on
+  // the line between such a square and the king, since then the king would
+  // already be in check, so the occupancy needn't be adjusted for its leaving.
+  uint64_t checkSquares[7] = {0};
+  checkSquares[KNIGHT] = KnightAttacks[ek];
+  checkSquares[BISHOP] = bishopAttacks(ek, occupied);
+  checkSquares[ROOK] = rookAttacks(ek, occupied);
+  checkSquares[QUEEN] = checkSquares[BISHOP] | checkSquares[ROOK];
+
+  // our pieces that are the only piece between one of our sliders and the king
+  uint64_t discoverers = 0;
+  uint64_t snipers =
+    (rookAttacks(ek, 0) & (board->pieceBB[sideToMove][ROOK] | board->pieceBB[sideToMove][QUEEN])) |
+    (bishopAttacks(ek, 0) & (board->pieceBB[sideToMove][BISHOP] | board->pieceBB[sideToMove][QUEEN]));
+  while (snipers) {
+    uint64_t blockers = BetweenBB[ek][pop_lsb(&snipers)] & occupied;
+    if (popcount64(blockers) == 1) {
+      discoverers |= blockers & board->colorBB[sideToMove];
+    }
+  }
+
+  uint64_t own = ci.evasions ? board->colorBB[sideToMove] : BB(ci.king);
+  while (own) {
+    unsigned int p = pop_lsb(&own);
+    int row = p2row(p);
+    int col = p2col(p);
+    Piece P = board->board[row][col].piece;
+    uint64_t targets = 0;
+    switch (P) {
+    case PAWN:
+    case KING: {
+      MoveList moves;
+      moves.n = 0;
+      if (P == PAWN) {
+        generatePawnMoves(board, &ci, row, col, &moves);
       } else {
-        if (board->board[M.toCol][M.toRow + 1].piece == PAWN &&
-            board->board[M.toCol][M.toRow + 1].color == WHITE) {
-          M.fromRow = M.toRow + 1;
-          return M;
-        }
-        if (board->board[M.toCol][M.toRow + 2].piece == PAWN &&
-            board->board[M.toCol][M.toRow + 2].color == WHITE &&
-            board->board[M.toCol][M.toRow + 1].piece == EMPTY) {
-          M.fromRow = M.toRow + 2;
-          return M;
+        generateKingMoves(board, &ci, row, col, &moves);
+      }
+      for (int i = 0; i < moves.n; ++i) {
+        if (givesCheck(board, sideToMove, moves.moves[i])) {
+          list->moves[list->n++] = moves.moves[i];
         }
-        error("String '%s' appears to be a pawn move but not valid.", x);
       }
-
-    } else {
-      // piece
-      Piece P = string2Piece(x);
-      unsigned int p = string2p(x);
-      M.toRow = p2row(p);
-      M.toCol = p2col(p);
-      unsigned int q = PieceBoard2p(P, sideToMove, board, p);
-      M.fromRow = p2row(q);
-      M.fromCol = p2col(q);
-      M.toPiece = string2Piece(x);
-
-
-
     }
-  }
-
-  return M;
-}
-
-static void hasRookMoved(int moves[2], Game * G, Color sideToMove) {
-  moves[0] = 0;
-  moves[1] = 0;
-  for (int m = 1; m < (G->move); ++m) {
-    if (moves[0] && moves[1]) {
+      continue;
+    case KNIGHT:
+      targets = KnightAttacks[p];
+      break;
+    case BISHOP:
+      targets = bishopAttacks(p, occupied);
+      break;
+    case ROOK:
+      targets = rookAttacks(p, occupied);
+      break;
+    case QUEEN:
+      targets = queenAttacks(p, occupied);
+      break;
+    default:
       break;
     }
-    if (G->Moves[m][sideToMove == BLACK].toPiece == ROOK) {
-      if (moves[0] == 0 && G->Moves[m][sideToMove == BLACK].fromCol == 0) {
-        moves[0] = m;
-      }
-      if (moves[1] == 0 && G->Moves[m][sideToMove == BLACK].fromCol == 7) {
-        moves[1] = m;
-      }
+    uint64_t checking = checkSquares[P];
+    if (discoverers & BB(p)) {
+      checking |= ~LineBB[ek][p];
     }
+    addMoves(list, p, targets & legalTargets(board, &ci, p) & checking);
   }
+  return list->n;
 }
 
-void verify_castling(Game * G, bool queenside, Color sideToMove) {
-  int c_castle = canCastle(&(G->Board), sideToMove);
-  int rook_moves[2] = {0};
-  hasRookMoved(rook_moves, G, sideToMove);
-
-  if (sideToMove == WHITE) {
-    if (rook_moves[!queenside]) {
-      error("On move %d castling was attempted, but WHITE's ROOK moved on moved %d",
-            G->move + 1, rook_moves[!queenside]);
-    }
-    if (G->whiteLostCastlingRights != LONG_GAME) {
-      error("On move %d castling was attempted, but WHITE lost castling rights on move %d",
-            G->move + 1, G->whiteLostCastlingRights);
+// Does the side to move have any legal move at all? Stops at the first one,
+// trying the likeliest first: king steps, then captures of a lone checker,
+// then each piece's targets as masks without listing the moves.
+bool hasLegalMove(const Chessboard * board, Color sideToMove) {
+  CheckInfo ci;
+  computeCheckInfo(board, sideToMove, &ci);
+  const Color them = OPPCOLOR;
+  const unsigned int k = ci.king;
+
+  const uint64_t occupied_sans_king = board->occupiedBB ^ BB(k);
+  uint64_t steps = KingAttacks[k] & ~(board->colorBB[sideToMove]);
+  while (steps) {
+    if (!isSquareAttackedOcc(board, pop_lsb(&steps), them, occupied_sans_king)) {
+      return true;
     }
+  }
+  // Castling needn't be considered: if it is legal, so is the step towards the rook
 
-    if (c_castle == 3) {
-      return;
-    }
-    if (isKingInCheck(&(G->Board), WHITE)) {
-      error("On move %d castling was attempted, but king is in check.", G->move + 1);
-    }
+  if (!ci.evasions) {
+    return false; // double check
+  }
+  // A pinned piece can never answer a check
+  const uint64_t movers = board->colorBB[sideToMove] & ~BB(k);
+  if (ci.checkers &&
+      (attackersTo(board, lsb64(ci.checkers), board->occupiedBB) & movers & ~ci.pinned)) {
+    return true;
+  }
 
-    if (queenside) {
-      if (G->Board.board[0][0].piece != ROOK || G->Board.board[0][0].color != WHITE) {
-        error("On move %d castling was attempted, but WHITE rook not on square a1.", G->move + 1);
-      }
-      for (int r = 1; r < 4; ++r) {
-        if (G->Board.board[0][r].piece != EMPTY) {
-          error("On move %d castling was attempted, but piece exists on square %c1.", G->move + 1, abcdefgh_[r]);
-        }
-      }
-      for (int r = 2; r < 3; ++r) {
-        if (wouldKingBeInCheck(&(G->Board), WHITE, 0, 4, 0, r, false)) {
-          error("On move %d castling was attempted, but king would be in check exists on square %c1.", G->move + 1, abcdefgh_[r]);
-        }
-      }
-    } else {
-      if (G->Board.board[0][7].piece != ROOK || G->Board.board[0][7].color != WHITE) {
-        error("On move %d castling was attempted, but WHITE rook not on square a1.", G->move + 1);
-      }
-      for (int r = 5; r < 7; ++r) {
-        if (G->Board.board[0][r].piece != EMPTY) {
-          error("On move %d castling was attempted, but piece exists on square %c1.", G->move + 1, abcdefgh_[r]);
-        }
-      }
-      for (int r = 5; r < 7; ++r) {
-        if (wouldKingBeInCheck(&(G->Board), WHITE, 0, 4, 0, r, false)) {
-          error("On move %d castling was attempted, but king would be in check exists on square %c1.", G->move + 1, abcdefgh_[r]);
-        }
+  uint64_t own = movers;
+  while (own) {
+    unsigned int p = pop_lsb(&own);
+    uint64_t targets = 0;
+    switch (board->board[p2row(p)][p2col(p)].piece) {
+    case PAWN: {
+      MoveList pawnMoves;
+      pawnMoves.n = 0;
+      generatePawnMoves(board, &ci, p2row(p), p2col(p), &pawnMoves);
+      if (pawnMoves.n) {
+        return true;
       }
     }
-  } else {
-    if (rook_moves[!queenside]) {
-      error("On move %d castling was attempted, but BLACK's ROOK moved on moved %d",
-            G->move + 1, rook_moves[!queenside]);
-    }
-    if (G->blackLostCastlingRights != LONG_GAME) {
-      error("On move %d castling was attempted, but BLACK lost castling rights on move %d",
-            G->blackLostCastlingRights, G->move + 1);
-    }
-    if (c_castle == 3) {
-      return;
+      continue;
+    case KNIGHT:
+      targets = KnightAttacks[p];
+      break;
+    case BISHOP:
+      targets = bishopAttacks(p, board->occupiedBB);
+      break;
+    case ROOK:
+      targets = rookAttacks(p, board->occupiedBB);
+      break;
+    case QUEEN:
+      targets = queenAttacks(p, board->occupiedBB);
+      break;
+    default:
+      break;
     }
-    if (queenside) {
-      if (G->Board.board[7][0].piece != ROOK || G->Board.board[7][0].color != WHITE) {
-        error("On move %d castling was attempted, but BLACK rook not on square a8.", G->move + 1);
-      }
-      for (int r = 1; r < 4; ++r) {
-        if (G->Board.board[7][r].piece != EMPTY) {
-          error("On move %d castling was attempted, but piece exists on square %c8.", G->move + 1, abcdefgh_[r]);
-        }
-      }
-      for (int r = 2; r < 3; ++r) {
-        if (wouldKingBeInCheck(&(G->Board), WHITE, 7, 4, 7, r, false)) {
-          error("On move %d castling was attempted, but king would be in check exists on square %c8.", G->move + 1, abcdefgh_[r]);
-        }
-      }
-    } else {
-      if (G->Board.board[7][7].piece != ROOK || G->Board.board[7][7].color != WHITE) {
-        error("On move %d castling was attempted, but BLACK rook not on square h8.", G->move + 1);
-      }
-      for (int r = 5; r < 7; ++r) {
-        if (G->Board.board[7][r].piece != EMPTY) {
-          error("On move %d castling was attempted, but piece exists on square %c8.", G->move + 1, abcdefgh_[r]);
-        }
-      }
-      for (int r = 5; r < 7; ++r) {
-        if (wouldKingBeInCheck(&(G->Board), WHITE, 7, 4, 7, r, false)) {
-          error("On move %d castling was attempted, but king would be in check exists on square %c8.", G->move + 1, abcdefgh_[r]);
-        }
-      }
+    if (targets & legalTargets(board, &ci, p)) {
+      return true;
     }
   }
+  return false;
 }
 
-void apply_castling(Game * G, bool queenside, Color sideToMove) {
-  verify_castling(G, queenside, sideToMove);
-  const bool isWhite = sideToMove == WHITE;
-  int KtoCol = queenside ? 2 : 6;
-  int KtoRow = isWhite ? 0 : 7;
-  int RtoCol = queenside ? 3 : 5;
-  int RtoRow = KtoRow;
-  unsigned int m = (G->move) + 1;
-  if (isWhite) {
-    G->Board.WhiteKing = rowcol2p(KtoRow, KtoCol);
-    G->whiteLostCastlingRights = m;
-    G->white_material[m] = G->white_material[m - 1];
-  } else {
-    G->Board.BlackKing = rowcol2p(KtoRow, KtoCol);
-    G->blackLostCastlingRights = m;
-    G->black_material[m] = G->black_material[m - 1];
+bool isCheckmate(const Chessboard* board, Color sideToMove) {
+  return isKingInCheck(board, sideToMove) && !hasLegalMove(board, sideToMove);
+}
+
+int isntValidBoard(const Chessboard * board, Color colorToMove) {
+  // 0 is valid
+  // 1 white king absent
+  // 2 black king absent
+  // 3 both kings absent
+  // 4 white king does not match duplicate record
+  // 5 black king does not match duplicate record
+  // 6 other king is in check
+  uint64_t whiteKings = board->pieceBB[WHITE][KING];
+  uint64_t blackKings = board->pieceBB[BLACK][KING];
+  if (!whiteKings || !blackKings) {
+    // one or both kings are absent
+    return (!whiteKings && !blackKings) ? 3 : (!whiteKings ? 1 : 2);
+  }
+  if (lsb64(whiteKings) != board->WhiteKing) {
+    return 4;
+  }
+  if (lsb64(blackKings) != board->BlackKing) {
+    return 5;
+  }
+
+  if (isKingInCheck(board, colorToMove == WHITE ? BLACK : WHITE)) {
+    return 6;
   }
-  G->Moves[m][!isWhite].fromCol = 3;
-  G->Moves[m][!isWhite].fromRow = KtoRow;
-  G->Moves[m][!isWhite].toCol = KtoCol;
-  G->Moves[m][!isWhite].toRow = KtoRow;
 
-  G->Board.board[KtoRow][4].piece = EMPTY;
-  G->Board.board[KtoRow][queenside ? 0 : 7].piece = EMPTY; // rook
-  G->Board.board[KtoRow][KtoCol].piece = KING;
-  G->Board.board[KtoRow][KtoCol].color = sideToMove;
-  G->Board.board[RtoRow][RtoCol].piece = ROOK;
-  G->Board.board[RtoRow][RtoCol].color = sideToMove;
 
 
+
+  return 0;
 }
 
-void apply_move2game(Game * G, Move M, Color sideToMove) {
-  unsigned int move = G->move;
+// positions only, not algebraic notation
+unsigned int string2p(const char * x) {
+  const char * letters = "abcdefgh";
 
-  ++move;
-  if (move >= LONG_GAME) {
-    error("move = %d >= LONG_GAME = %d", move, LONG_GAME);
-  }
-  switch(M.toPiece) {
-  case KING:
-    if (sideToMove == WHITE) {
-      G->Board.WhiteKing = rowcol2p(M.toRow, M.toCol);
-      if (G->whiteLostCastlingRights == LONG_GAME) {
-        G->whiteLostCastlingRights = move;
-      }
-      G->Board.lastMove = M;
-      G->Board.board[M.fromRow][M.fromCol].piece = EMPTY;
-      G->Board.board[M.toRow][M.toCol].piece = KING;
-      G->Board.board[M.toRow][M.toCol].color = WHITE;
-      G->Moves[move][0] = M;
-    } else {
-      G->Board.BlackKing = rowcol2p(M.toRow, M.toCol);
-      if (G->blackLostCastlingRights == LONG_GAME) {
-        G->blackLostCastlingRights = move;
+  if (isupper(x[0])) {
+    if (strlen(x) < 3) {
+      error("strlen(x = %s) < 3", x);
+    }
+    for (int c = 0; c < 8; ++c) {
+      if (x[1] == letters[c]) {
+
+        unsigned int oooo =  rowcol2p(x[2] - '1', c);
+        return oooo;
       }
-      G->Board.lastMove = M;
-      G->Board.board[M.fromRow][M.fromCol].piece = EMPTY;
-      G->Board.board[M.toRow][M.toCol].piece = KING;
-      G->Board.board[M.toRow][M.toCol].color = BLACK;
-      G->Moves[move][1] = M;
     }
-    break;
-  default:
-    if (sideToMove == WHITE) {
-      G->Board.lastMove = M;
-      bool is_enpassant =
-        M.toPiece == PAWN &&
-        M.toRow == 6 &&
-        M.toCol != M.fromCol &&
-        G->Board.board[M.toRow][M.toCol].piece == EMPTY &&
-        G->Board.board[M.fromRow][M.toCol].piece == PAWN &&
-        G->Board.board[M.fromRow][M.toCol].color == BLACK;
-
-      G->Board.board[M.fromRow][M.fromCol].piece = EMPTY;
-      G->Board.board[M.toRow][M.toCol].piece = M.toPiece;
-      G->Board.board[M.toRow][M.toCol].color = WHITE;
-      if (is_enpassant) {
-        G->Board.board[M.fromRow][M.toCol].piece = EMPTY;
+  } else {
+    for (int c = 0; c < 8; ++c) {
+      if (x[0] == letters[c]) {
+        return rowcol2p(x[1] - '1', c);
       }
-      G->Moves[move][0] = M;
+    }
+  }
+  error("(string2p)Could not determine position from string '%s'", x);
+}
 
+Piece string2Piece(const char * x) {
+  switch(x[0]) {
+  case 'K':
+    return KING;
+  case 'Q':
+    return QUEEN;
+  case 'B':
+    return BISHOP;
+  case 'N':
+    return KNIGHT;
+  case 'R':
+    return ROOK;
+  default:
+    return PAWN;
+  }
+}
 
-    } else {
-      G->Board.lastMove = M;
-      bool is_enpassant =
-        M.toPiece == PAWN &&
-        M.toRow == 4 &&
-        M.toCol != M.fromCol &&
-        G->Board.board[M.toRow][M.toCol].piece == EMPTY &&
-        G->Board.board[M.fromRow][M.toCol].piece == PAWN &&
-        G->Board.board[M.fromRow][M.toCol].color == WHITE;
-      G->Board.board[M.fromRow][M.fromCol].piece = EMPTY;
-      G->Board.board[M.toRow][M.toCol].piece = M.toPiece;
-      G->Board.board[M.toRow][M.toCol].color = BLACK;
-      if (is_enpassant) {
-        G->Board.board[M.fromRow][M.toCol].piece = EMPTY;
-      }
-      G->Moves[move][1] = M;
+// Record in G the legal move m, also known as M, for which there is room
+static void play_move(Game * G, Move M, Move16 m, Color sideToMove) {
+  unsigned int move = G->move + 1;
+  if (M.toPiece == KING) {
+    if (sideToMove == WHITE && G->whiteLostCastlingRights == LONG_GAME) {
+      G->whiteLostCastlingRights = move;
+    }
+    if (sideToMove == BLACK && G->blackLostCastlingRights == LONG_GAME) {
+      G->blackLostCastlingRights = move;
     }
   }
-  Material Mat;
-  determine_material(&Mat, &(G->Board), WHITE);
-  G->white_material[move] = total_material(&Mat);
-  determine_material(&Mat, &(G->Board), BLACK);
-  G->black_material[move] = total_material(&Mat);
-  if (M.toPiece == PAWN) {
+  const bool pawn_move = G->Board.board[M.fromRow][M.fromCol].piece == PAWN;
+  Undo u;
+  make_move(&(G->Board), m, &u);
+  G->Moves[move][sideToMove == BLACK] = M;
+
+  // Only captures and promotions change the material
+  if (u.captured.piece != EMPTY) {
+    adjust_material(&(G->material[u.captured.color]), u.captured.piece, MOVE16_TO(m), -1);
+  }
+  if (MOVE16_KIND(m) == MOVE_PROMOTION) {
+    adjust_material(&(G->material[sideToMove]), PAWN, MOVE16_FROM(m), -1);
+    adjust_material(&(G->material[sideToMove]), MOVE16_PROMOTED(m), MOVE16_TO(m), 1);
+  }
+  G->white_material[move] = total_material(&(G->material[WHITE]));
+  G->black_material[move] = total_material(&(G->material[BLACK]));
+  if (pawn_move) {
     G->last_pawn_move = move;
   }
   G->sideToMove = OPPCOLOR;
   G->move += (sideToMove == BLACK);
 }
 
+// Play a move in algebraic notation: SAN_OK, a SAN_ error, or GAME_TOO_LONG.
+// Raises no error, so games may be replayed on any thread.
+int play_san(Game * G, const char * san) {
+  if (G->move + 1 >= LONG_GAME) {
+    return GAME_TOO_LONG;
+  }
+  Move16 m;
+  int o = san2move16(&(G->Board), G->sideToMove, san, &m);
+  if (o != SAN_OK) {
+    return o;
+  }
+  const unsigned int from = MOVE16_FROM(m);
+  const unsigned int to = MOVE16_TO(m);
+  Move M;
+  M.fromRow = p2row(from);
+  M.fromCol = p2col(from);
+  M.toRow = p2row(to);
+  M.toCol = p2col(to);
+  M.toPiece = (MOVE16_KIND(m) == MOVE_PROMOTION) ? MOVE16_PROMOTED(m) : G->Board.board[M.fromRow][M.fromCol].piece;
+  play_move(G, M, m, G->sideToMove);
+  return SAN_OK;
+}
+
+// The CHARs of a character vector, NULL for NA, for the threads to read
+static const char ** strings2chars(SEXP x) {
+  const R_xlen_t n = xlength(x);
+  const char ** ans = (const char **)R_alloc(n ? n : 1, sizeof(const char *));
+  for (R_xlen_t i = 0; i < n; ++i) {
+    SEXP s = STRING_ELT(x, i);
+    ans[i] = (s == NA_STRING) ? NULL : CHAR(s);
+  }
+  return ans;
+}
+
+// Replay from the start the game of white's nx moves x and black's ny
+// moves y, NULL for NA. Reads only these C strings, so any thread may call
+// it. Returns SAN_OK or the error, with *ply the number of plies played, or
+// the ply of the move in error.
+static int replay_game(Game * G, const char ** x, R_xlen_t nx, const char ** y, R_xlen_t ny, int * ply) {
+  initialize_Game(G);
+  *ply = 0;
+  if (ny != nx && ny != nx - 1) {
+    return GAME_LENGTHS;
+  }
+  for (int i = 0; i < nx + ny; ++i) {
+    const char * san = ((i & 1) ? y : x)[i >> 1];
+    int o = san == NULL ? SAN_MALFORMED : play_san(G, san);
+    if (o != SAN_OK) {
+      *ply = i + 1;
+      return o;
+    }
+  }
+  *ply = nx + ny;
+  return SAN_OK;
+}
+
 void setup_board(Chessboard * board, SEXP x, SEXP y, SEXP Start, Color sideToMove, SEXP LastMove) {
   const int start = asInteger(Start);
   if (start == 0) {
     blankBoard(board);
-    board->WhiteMayCastle = 0;
-    board->BlackMayCastle = 0;
   } else if (start == 1) {
     startingPosition(board);
-    if (!length(x) && !length(y) && !length(LastMove)) {
-      return; // just the starting position
-    }
   } else {
     error("Invalid start.");
   }
+  if (sideToMove == BLACK) {
+    board->key ^= ZobristSide;
+  }
+  if (start == 1 && !length(x) && !length(y) && !length(LastMove)) {
+    return; // just the starting position
+  }
   int n = length(x);
   const SEXP * xp = STRING_PTR(x);
   for (int i = 0; i < n; ++i) {
@@ -1974,28 +1247,27 @@ void setup_board(Chessboard * board, SEXP x, SEXP y, SEXP Start, Color sideToMov
     unsigned int p = string2p(xi);
     int r = p2row(p);
     int c = p2col(p);
-    board->board[r][c].color = WHITE;
     if (islower(xi[0])) {
-      board->board[r][c].piece = PAWN;
+      setSquare(board, r, c, PAWN, WHITE);
       continue;
     }
     switch(xi[0]) {
     case 'K': {
-      board->board[r][c].piece = KING;
+      setSquare(board, r, c, KING, WHITE);
       board->WhiteKing = p;
     }
       break;
     case 'Q':
-      board->board[r][c].piece = QUEEN;
+      setSquare(board, r, c, QUEEN, WHITE);
       break;
     case 'B':
-      board->board[r][c].piece = BISHOP;
+      setSquare(board, r, c, BISHOP, WHITE);
       break;
     case 'N':
-      board->board[r][c].piece = KNIGHT;
+      setSquare(board, r, c, KNIGHT, WHITE);
       break;
     case 'R':
-      board->board[r][c].piece = ROOK;
+      setSquare(board, r, c, ROOK, WHITE);
       break;
     default:
       error("Could not determine piece from string '%s'.", xi);
@@ -2016,28 +1288,27 @@ void setup_board(Chessboard * board, SEXP x, SEXP y, SEXP Start, Color sideToMov
     unsigned int p = string2p(xi);
     int r = p2row(p);
     int c = p2col(p);
-    board->board[r][c].color = BLACK;
     if (islower(xi[0])) {
-      board->board[r][c].piece = PAWN;
+      setSquare(board, r, c, PAWN, BLACK);
       continue;
     }
     switch(xi[0]) {
     case 'K': {
-      board->board[r][c].piece = KING;
+      setSquare(board, r, c, KING, BLACK);
       board->BlackKing = p;
     }
       break;
     case 'Q':
-      board->board[r][c].piece = QUEEN;
+      setSquare(board, r, c, QUEEN, BLACK);
       break;
     case 'R':
-      board->board[r][c].piece = ROOK;
+      setSquare(board, r, c, ROOK, BLACK);
       break;
     case 'B':
-      board->board[r][c].piece = BISHOP;
+      setSquare(board, r, c, BISHOP, BLACK);
       break;
     case 'N':
-      board->board[r][c].piece = KNIGHT;
+      setSquare(board, r, c, KNIGHT, BLACK);
       break;
     default:
       error("Could not determine piece from string '%s'.", xi);
@@ -2091,6 +1362,8 @@ void setup_board(Chessboard * board, SEXP x, SEXP y, SEXP Start, Color sideToMov
   }
 
 
+  board->key ^= enPassantKey(board);
+
   if (isntValidBoard(board, sideToMove)) {
     error("isntValidBoard[%d]", isntValidBoard(board, sideToMove));
   }
@@ -2104,6 +1377,192 @@ SEXP C_isCheckmate(SEXP x, SEXP y, SEXP Start, SEXP WhiteToMove, SEXP LastMove)
   return ScalarLogical(isCheckmate(&Board, sideToMove));
 }
 
+// "Ke1" or "e4", any 'x' after the piece ignored: the square, or -1 if the
+// string is malformed
+int piece_square(const char * s, Piece * P) {
+  *P = PAWN;
+  if (isupper(s[0])) {
+    switch (s[0]) {
+    case 'K':
+      *P = KING;
+      break;
+    case 'Q':
+      *P = QUEEN;
+      break;
+    case 'R':
+      *P = ROOK;
+      break;
+    case 'B':
+      *P = BISHOP;
+      break;
+    case 'N':
+      *P = KNIGHT;
+      break;
+    default:
+      return -1;
+    }
+    ++s;
+  }
+  if (s[0] == 'x') {
+    ++s;
+  }
+  if (s[0] < 'a' || s[0] > 'h' || s[1] < '1' || s[1] > '8') {
+    return -1;
+  }
+  return rowcol2p(s[1] - '1', s[0] - 'a');
+}
+
+// setup_board() for any thread: reads only C strings gathered beforehand on
+// the main thread, so nothing is allocated and nothing raised. x and y are
+// nx and ny squares, NULL for NA; last_move is NULL for NA.
+// Returns 0, or nonzero if the position is malformed or invalid.
+static int strings2board(Chessboard * board, const char ** x, R_xlen_t nx, const char ** y, R_xlen_t ny,
+                         int start, Color sideToMove, const char * last_move_s) {
+  if (start == 0) {
+    blankBoard(board);
+  } else if (start == 1) {
+    startingPosition(board);
+  } else {
+    return 1;
+  }
+  if (sideToMove == BLACK) {
+    board->key ^= ZobristSide;
+  }
+  for (int C = WHITE; C <= BLACK; ++C) {
+    const char ** pieces = (C == WHITE) ? x : y;
+    const R_xlen_t n = (C == WHITE) ? nx : ny;
+    for (R_xlen_t i = 0; i < n; ++i) {
+      const char * s = pieces[i];
+      if (s == NULL || *s == '\0') {
+        continue;
+      }
+      Piece P;
+      int p = piece_square(s, &P);
+      if (p < 0) {
+        return 1;
+      }
+      setSquare(board, p2row(p), p2col(p), P, (Color)C);
+      if (P == KING) {
+        if (C == WHITE) {
+          board->WhiteKing = p;
+        } else {
+          board->BlackKing = p;
+        }
+      }
+    }
+  }
+  if (last_move_s == NULL) {
+    return 1;
+  }
+  // as setup_board(): e2e4 or Qa1a7, here with any 'x' ignored
+  char last_move[6];
+  int len = 0;
+  for (const char * c = last_move_s; *c; ++c) {
+    if (*c == 'x') {
+      continue;
+    }
+    if (len == 5) {
+      return 1;
+    }
+    last_move[len++] = *c;
+  }
+  if (len != 4 && len != 5) {
+    return 1;
+  }
+  const char * from = last_move + (len - 4);
+  for (int j = 0; j < 4; j += 2) {
+    if (from[j] < 'a' || from[j] > 'h' || from[j + 1] < '1' || from[j + 1] > '8') {
+      return 1;
+    }
+  }
+  board->lastMove.toPiece = (len == 4) ? PAWN : string2Piece(last_move);
+  board->lastMove.fromCol = from[0] - 'a';
+  board->lastMove.fromRow = from[1] - '1';
+  board->lastMove.toCol = from[2] - 'a';
+  board->lastMove.toRow = from[3] - '1';
+  board->key ^= enPassantKey(board);
+  return isntValidBoard(board, sideToMove);
+}
+
+// is_checkmate() for N positions at once: X and Y lists of the pieces'
+// squares, the rest a value per position. NA for a position that cannot be
+// set up, since the threads cannot raise errors.
+SEXP C_isCheckmateMany(SEXP X, SEXP Y, SEXP Start, SEXP WhiteToMove, SEXP LastMove, SEXP nthreads) {
+  if (!isNewList(X) || !isNewList(Y)) {
+    error("`x` and `y` must be lists.");
+  }
+  const R_xlen_t N = xlength(X);
+  if (xlength(Y) != N || !isInteger(Start) || xlength(Start) != N ||
+      !isLogical(WhiteToMove) || xlength(WhiteToMove) != N ||
+      !isString(LastMove) || xlength(LastMove) != N) {
+    error("Every field of the positions must have one value per position.");
+  }
+  for (R_xlen_t i = 0; i < N; ++i) {
+    if (!isString(VECTOR_ELT(X, i)) || !isString(VECTOR_ELT(Y, i))) {
+      error("Position %lld: the pieces must be character vectors.", (long long)(i + 1));
+    }
+  }
+  int nThread = asInteger(nthreads);
+  if (nThread == NA_INTEGER || nThread < 1) {
+    error("`nThread` must be a positive integer.");
+  }
+  const int * start = INTEGER(Start);
+  const int * white_to_move = LOGICAL(WhiteToMove);
+  // the R API is not thread-safe: gather every string here first
+  const char *** x = (const char ***)R_alloc(N ? N : 1, sizeof(const char **));
+  const char *** y = (const char ***)R_alloc(N ? N : 1, sizeof(const char **));
+  R_xlen_t * nx = (R_xlen_t *)R_alloc(N ? N : 1, sizeof(R_xlen_t));
+  R_xlen_t * ny = (R_xlen_t *)R_alloc(N ? N : 1, sizeof(R_xlen_t));
+  for (R_xlen_t i = 0; i < N; ++i) {
+    x[i] = strings2chars(VECTOR_ELT(X, i));
+    y[i] = strings2chars(VECTOR_ELT(Y, i));
+    nx[i] = xlength(VECTOR_ELT(X, i));
+    ny[i] = xlength(VECTOR_ELT(Y, i));
+  }
+  const char ** last_move = strings2chars(LastMove);
+  SEXP ans = PROTECT(allocVector(LGLSXP, N));
+  int * ansp = LOGICAL(ans);
+  FORLOOP({
+    Chessboard board;
+    Color sideToMove = white_to_move[i] ? WHITE : BLACK;
+    if (white_to_move[i] == NA_LOGICAL ||
+        strings2board(&board, x[i], nx[i], y[i], ny[i], start[i], sideToMove, last_move[i])) {
+      ansp[i] = NA_LOGICAL;
+    } else {
+      ansp[i] = isCheckmate(&board, sideToMove);
+    }
+  })
+  UNPROTECT(1);
+  return ans;
+}
+
+// is_checkmate() for positions in FEN, NA for any that is invalid
+SEXP C_isCheckmateFen(SEXP Fen, SEXP nthreads) {
+  if (!isString(Fen)) {
+    error("`positions` must be a character vector of FEN.");
+  }
+  const R_xlen_t N = xlength(Fen);
+  int nThread = asInteger(nthreads);
+  if (nThread == NA_INTEGER || nThread < 1) {
+    error("`nThread` must be a positive integer.");
+  }
+  // the R API is not thread-safe: gather the strings here first
+  const char ** fen = strings2chars(Fen);
+  SEXP ans = PROTECT(allocVector(LGLSXP, N));
+  int * ansp = LOGICAL(ans);
+  FORLOOP({
+    Chessboard board;
+    Color sideToMove;
+    if (fen[i] == NULL || parse_fen(&board, &sideToMove, fen[i], NULL)) {
+      ansp[i] = NA_LOGICAL;
+    } else {
+      ansp[i] = isCheckmate(&board, sideToMove);
+    }
+  })
+  UNPROTECT(1);
+  return ans;
+}
+
 
 
 bool threefold_repetition(Game * G) {
@@ -2164,9 +1623,7 @@ bool isDraw(const Chessboard * board, Color sideToMove) {
   if (hasInsufficientMaterial(board)) {
     return true;
   }
-  Move possibleMoves[MAX_MOVES];
-  int numPossibleMoves = generateMoves(board, sideToMove, possibleMoves);
-  if (numPossibleMoves == 0 && !isKingInCheck(board, sideToMove)) {
+  if (!isKingInCheck(board, sideToMove) && !hasLegalMove(board, sideToMove)) {
     // stalemate
     return true;
   }
@@ -2246,82 +1703,268 @@ void print_board(const Chessboard * board) {
 }
 
 void sexp2game(Game * G, SEXP x, SEXP y) {
-  initialize_Game(G);
-  int n = length(x);
-  if (n != length(y) && (n - 1) != length(y)) {
+  int ply;
+  const int o = replay_game(G, strings2chars(x), xlength(x), strings2chars(y), xlength(y), &ply);
+  if (o == SAN_OK) {
+    return;
+  }
+  if (o == GAME_LENGTHS) {
     error("Lengths of x and y do not agree. length(x) = %d, length(y) = %d", length(x), length(y));
   }
-  const SEXP * xp = STRING_PTR(x);
-  const SEXP * yp = STRING_PTR(y);
-  for (int i = 0; i < n; ++i) {
-    const char * xpi = CHAR(xp[i]);
-    int npi = length(xp[i]);
-    if (xpi[0] == 'O' && xpi[1] == '-') {
-      apply_castling(G, npi > 3, WHITE);
-      continue;
-    }
+  if (o == GAME_TOO_LONG) {
+    error("The game is longer than %d moves.", LONG_GAME - 1);
+  }
+  SEXP san = STRING_ELT((ply & 1) ? x : y, (ply - 1) >> 1);
+  error("Move %d for %s, '%s': %s.", (ply + 1) / 2, (ply & 1) ? "white" : "black",
+        san == NA_STRING ? "NA" : CHAR(san), san_error_message(o));
+}
 
-    Move M_i = string2move(xpi, npi, &(G->Board), WHITE);
-    apply_move2game(G, M_i, WHITE);
-    if (i < length(y)) {
-      npi = length(yp[i]);
-      const char * ypi = CHAR(yp[i]);
-      if (ypi[0] == 'O' && ypi[1] == '-') {
-        apply_castling(G, npi > 3, BLACK);
-        continue;
-      }
-      M_i = string2move(CHAR(yp[i]), length(yp[i]), &(G->Board), BLACK);
-      apply_move2game(G, M_i, BLACK);
-    }
 
+// -1 if white is mated, 1 if black, else 0
+int board2outcome(const Chessboard * board) {
+  if (isCheckmate(board, WHITE)) {
+    return -1;
+  }
+  if (isCheckmate(board, BLACK)) {
+    return 1;
   }
+  return 0;
 }
 
-
 SEXP C_game2outcome(SEXP x, SEXP y) {
-  Game * G;
+  Game Game_;
+  Game * G = &Game_;
   sexp2game(G, x, y);
-  if (isCheckmate(&(G->Board), WHITE)) {
-    return ScalarInteger(-1);
-  }
-
-  if (isCheckmate(&(G->Board), BLACK)) {
-    return ScalarInteger(1);
+  const int outcome = board2outcome(&(G->Board));
+  if (outcome) {
+    return ScalarInteger(outcome);
   }
   print_board(&(G->Board));
   Rprintf("\nKing in Check: %d %d", isKingInCheck(&(G->Board), WHITE), isKingInCheck(&(G->Board), BLACK));
   return ScalarInteger(0);
 }
 
-bool checkmate_in_n(Game * G, int n) {
-  if (n <= 0) {
-    return isCheckmate(&(G->Board), G->sideToMove);
-  }
-  Move Moves[MAX_MOVES];
-  int num_moves = generateMoves(&(G->Board), G->sideToMove, Moves);
-
-  if (num_moves == 0) {
-    return false;
-  }
-  for (int m = 0; m < num_moves; ++m) {
-    Game G2 = *G;
-    apply_move2game(G, Moves[m], G->sideToMove);
-    if (checkmate_in_n(G, n - 1)) {
-      return true;
-    }
-    G = &G2;
-  }
-  return false;
+// game2outcome() for N games, X and Y lists of the moves of white and of
+// black, replayed by nThread threads each with its own Game. A game that
+// cannot be replayed has an error code and outcome NA rather than stopping
+// the rest. Returns the outcomes, the error codes and the numbers of plies
+// replayed, to and including any in error.
+SEXP C_games2outcome(SEXP X, SEXP Y, SEXP nthreads) {
+  if (!isNewList(X) || !isNewList(Y)) {
+    error("`x` and `y` must be lists.");
+  }
+  const R_xlen_t N = xlength(X);
+  if (xlength(Y) != N) {
+    error("`x` and `y` must have the same length, one element per game.");
+  }
+  for (R_xlen_t i = 0; i < N; ++i) {
+    if (!isString(VECTOR_ELT(X, i)) || !isString(VECTOR_ELT(Y, i))) {
+      error("Game %lld: the moves must be character vectors.", (long long)(i + 1));
+    }
+  }
+  int nThread = asInteger(nthreads);
+  if (nThread == NA_INTEGER || nThread < 1) {
+    error("`nThread` must be a positive integer.");
+  }
+#ifndef _OPENMP
+  nThread = 1;
+#endif
+  // the R API is not thread-safe: gather every move here first
+  const char *** x = (const char ***)R_alloc(N ? N : 1, sizeof(const char **));
+  const char *** y = (const char ***)R_alloc(N ? N : 1, sizeof(const char **));
+  R_xlen_t * nx = (R_xlen_t *)R_alloc(N ? N : 1, sizeof(R_xlen_t));
+  R_xlen_t * ny = (R_xlen_t *)R_alloc(N ? N : 1, sizeof(R_xlen_t));
+  for (R_xlen_t i = 0; i < N; ++i) {
+    x[i] = strings2chars(VECTOR_ELT(X, i));
+    y[i] = strings2chars(VECTOR_ELT(Y, i));
+    nx[i] = xlength(VECTOR_ELT(X, i));
+    ny[i] = xlength(VECTOR_ELT(Y, i));
+  }
+  // a Game per thread, reused from game to game
+  Game * games = (Game *)R_alloc(nThread, sizeof(Game));
+  SEXP ans = PROTECT(allocVector(VECSXP, 3));
+  SEXP Outcome = PROTECT(allocVector(INTSXP, N));
+  SEXP Error = PROTECT(allocVector(INTSXP, N));
+  SEXP Ply = PROTECT(allocVector(INTSXP, N));
+  int * outcome = INTEGER(Outcome);
+  int * err = INTEGER(Error);
+  int * ply = INTEGER(Ply);
+  FORLOOP({
+    Game * G = &games[thread_num()];
+    err[i] = replay_game(G, x[i], nx[i], y[i], ny[i], &ply[i]);
+    outcome[i] = err[i] ? NA_INTEGER : board2outcome(&(G->Board));
+  })
+  SET_VECTOR_ELT(ans, 0, Outcome);
+  SET_VECTOR_ELT(ans, 1, Error);
+  SET_VECTOR_ELT(ans, 2, Ply);
+  UNPROTECT(4);
+  return ans;
 }
 
-SEXP C_CheckmateInN(SEXP x, SEXP y, SEXP nn) {
+// Can the side to move force mate in n moves? The answer carries the
+// mating line as attribute "line", in coordinate notation.
+SEXP C_CheckmateInN(SEXP x, SEXP y, SEXP nn, SEXP HashMb, SEXP nthreads, SEXP LazySMP, SEXP ChecksOnly,
+                    SEXP MaxNodes, SEXP MaxTimeMs) {
   const int n = asInteger(nn);
+  if (n == NA_INTEGER || n < 0 || n > MATE_MAX_MOVES) {
+    error("`n` must be an integer between 0 and %d.", MATE_MAX_MOVES);
+  }
+  const double hash_mb = asReal(HashMb);
+  if (ISNAN(hash_mb) || hash_mb < 0) {
+    error("`hash_mb` must be a nonnegative number.");
+  }
+  int nThread = asInteger(nthreads);
+  if (nThread == NA_INTEGER || nThread < 1) {
+    error("`nThread` must be a positive integer.");
+  }
+#ifndef _OPENMP
+  nThread = 1;
+#endif
   Game G;
   sexp2game(&G, x, y);
-  return ScalarLogical(checkmate_in_n(&G, n));
+  if (n == 0) {
+    return ScalarLogical(isCheckmate(&(G.Board), G.sideToMove));
+  }
+  // one search per thread, all sharing the table; R_alloc'd, so freed on
+  // return or error
+  MateSearch * S = (MateSearch *)R_alloc(nThread, sizeof(MateSearch));
+  memset(S, 0, nThread * sizeof(MateSearch));
+  uint64_t entries = mate_table_size(hash_mb);
+  for (int t = 0; t < nThread; ++t) {
+    S[t].checks_only = asLogical(ChecksOnly) == TRUE;
+  }
+  if (entries) {
+    MateEntry * table = (MateEntry *)R_alloc(entries, sizeof(MateEntry));
+    memset(table, 0, entries * sizeof(MateEntry));
+    for (int t = 0; t < nThread; ++t) {
+      S[t].table = table;
+      S[t].mask = entries - 1;
+    }
+  }
+  SearchLimits L;
+  limits_init(&L, asReal(MaxNodes), asReal(MaxTimeMs));
+  for (int t = 0; t < nThread; ++t) {
+    S[t].limits = &L;
+  }
+  Move16 line[2 * MATE_MAX_MOVES];
+  int len = 0;
+  int depth = 0;
+  bool lazy = asLogical(LazySMP) == TRUE;
+  int k = mate_search(S, nThread, lazy, &(G.Board), G.sideToMove, n, line, &len, &depth);
+  if (L.out == LIMIT_INTERRUPT) {
+    error("The search was interrupted.");
+  }
+  uint64_t nodes = 0;
+  for (int t = 0; t < nThread; ++t) {
+    nodes += S[t].nodes;
+  }
+
+  SEXP ans = PROTECT(ScalarLogical(k < 0 ? NA_LOGICAL : k > 0));
+  SEXP Line = PROTECT(allocVector(STRSXP, len));
+  for (int i = 0; i < len; ++i) {
+    char uci[6];
+    move16_to_uci(line[i], uci);
+    SET_STRING_ELT(Line, i, mkChar(uci));
+  }
+  setAttrib(ans, install("line"), Line);
+  setAttrib(ans, install("depth"), ScalarInteger(depth));
+  setAttrib(ans, install("nodes"), ScalarReal((double)nodes));
+  UNPROTECT(2);
+  return ans;
 }
 
+// Mate by proof-number search, from the game x, y or, if given, a FEN.
+// Returns list(result, line, nodes): result NA if the budget ran out.
+// The position after the moves x and y or, if Fen is not NULL, in Fen
+static void sexp2position(Game * G, SEXP x, SEXP y, SEXP Fen) {
+  if (isNull(Fen)) {
+    sexp2game(G, x, y);
+    return;
+  }
+  if (!isString(Fen) || length(Fen) != 1 || STRING_ELT(Fen, 0) == NA_STRING) {
+    error("`fen` must be a single string.");
+  }
+  const char * msg = parse_fen(&(G->Board), &(G->sideToMove), CHAR(STRING_ELT(Fen, 0)), NULL);
+  if (msg) {
+    error("Invalid FEN: %s.", msg);
+  }
+}
 
+SEXP C_SolveMate(SEXP x, SEXP y, SEXP Fen, SEXP MaxNodes, SEXP MaxTimeMs) {
+  const double max_nodes = asReal(MaxNodes);
+  if (ISNAN(max_nodes) || max_nodes < 1) {
+    error("`max_nodes` must be a positive number.");
+  }
+  Game G;
+  sexp2position(&G, x, y, Fen);
+  Move16 line[PNS_MAX_PLIES];
+  int len = 0;
+  uint64_t nodes = 0;
+  SearchLimits L;
+  limits_init(&L, 0, asReal(MaxTimeMs));
+  // as limits_init(): a budget beyond uint64_t, or Inf, is no budget at all
+  const uint64_t max_tree = max_nodes < 1.8e19 ? (uint64_t)max_nodes : UINT64_MAX;
+  int result = pn_search(&(G.Board), G.sideToMove, max_tree, &L, line, &len, &nodes);
+  if (L.out == LIMIT_INTERRUPT) {
+    error("The search was interrupted.");
+  }
+
+  SEXP ans = PROTECT(allocVector(VECSXP, 3));
+  SEXP Line = PROTECT(allocVector(STRSXP, len));
+  for (int i = 0; i < len; ++i) {
+    char uci[6];
+    move16_to_uci(line[i], uci);
+    SET_STRING_ELT(Line, i, mkChar(uci));
+  }
+  SET_VECTOR_ELT(ans, 0, ScalarLogical(result < 0 ? NA_LOGICAL : result));
+  SET_VECTOR_ELT(ans, 1, Line);
+  SET_VECTOR_ELT(ans, 2, ScalarReal((double)nodes));
+  SEXP names = PROTECT(allocVector(STRSXP, 3));
+  SET_STRING_ELT(names, 0, mkChar("result"));
+  SET_STRING_ELT(names, 1, mkChar("line"));
+  SET_STRING_ELT(names, 2, mkChar("nodes"));
+  setAttrib(ans, R_NamesSymbol, names);
+  UNPROTECT(3);
+  return ans;
+}
 
-
-
+SEXP C_BestMove(SEXP x, SEXP y, SEXP Fen, SEXP Depth, SEXP MaxNodes, SEXP MaxTimeMs) {
+  const int depth = asInteger(Depth);
+  if (depth == NA_INTEGER || depth < 1 || depth >= SEARCH_MAX_PLY) {
+    error("`depth` must be an integer between 1 and %d.", SEARCH_MAX_PLY - 1);
+  }
+  Game G;
+  sexp2position(&G, x, y, Fen);
+  Search * S = (Search *)R_alloc(1, sizeof(Search));
+  SearchLimits L;
+  limits_init(&L, asReal(MaxNodes), asReal(MaxTimeMs));
+  S->limits = &L;
+  Move16 line[SEARCH_MAX_PLY];
+  int len = 0, score = 0, depth_reached = 0;
+  search_best_move(S, &(G.Board), G.sideToMove, depth, line, &len, &score, &depth_reached);
+  if (L.out == LIMIT_INTERRUPT) {
+    error("The search was interrupted.");
+  }
+
+  SEXP ans = PROTECT(allocVector(VECSXP, 5));
+  SEXP PV = PROTECT(allocVector(STRSXP, len));
+  for (int i = 0; i < len; ++i) {
+    char uci[6];
+    move16_to_uci(line[i], uci);
+    SET_STRING_ELT(PV, i, mkChar(uci));
+  }
+  SET_VECTOR_ELT(ans, 0, len ? ScalarString(STRING_ELT(PV, 0)) : ScalarString(NA_STRING));
+  SET_VECTOR_ELT(ans, 1, ScalarInteger(len && !depth_reached ? NA_INTEGER : score));
+  SET_VECTOR_ELT(ans, 2, PV);
+  SET_VECTOR_ELT(ans, 3, ScalarInteger(depth_reached));
+  SET_VECTOR_ELT(ans, 4, ScalarReal((double)S->nodes));
+  SEXP names = PROTECT(allocVector(STRSXP, 5));
+  SET_STRING_ELT(names, 0, mkChar("move"));
+  SET_STRING_ELT(names, 1, mkChar("score"));
+  SET_STRING_ELT(names, 2, mkChar("pv"));
+  SET_STRING_ELT(names, 3, mkChar("depth"));
+  SET_STRING_ELT(names, 4, mkChar("nodes"));
+  setAttrib(ans, R_NamesSymbol, names);
+  UNPROTECT(3);
+  return ans;
+}
@@ -14,6 +14,11 @@
 #include <math.h>
 #include <ctype.h>
 
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#include <immintrin.h>
+#define CHESS_HAS_PEXT
+#endif
+
 
 
 #if (__GNUC__ > 7) || \
@@ -36,6 +41,363 @@ for (R_xlen_t i = 0; i < N; ++i) {                             \
 #endif
 
 
+// Bitboards: bit p is set for square p = (row << 3) + col, so a1 = 0, h8 = 63
+#define BB(p) (((uint64_t)1) << (p))
+#define LIGHT_SQUARES 0x55AA55AA55AA55AAULL
+
+static inline int popcount64(uint64_t x) {
+#if defined(__GNUC__) || defined(__clang__)
+  return __builtin_popcountll(x);
+#else
+  int o = 0;
+  for (; x; x &= x - 1) {
+    ++o;
+  }
+  return o;
+#endif
+}
+
+// index of the least significant set bit; x must be nonzero
+static inline int lsb64(uint64_t x) {
+#if defined(__GNUC__) || defined(__clang__)
+  return __builtin_ctzll(x);
+#else
+  int o = 0;
+  while (!(x & 1)) {
+    x >>= 1;
+    ++o;
+  }
+  return o;
+#endif
+}
+
+// remove and return the least significant set bit
+static inline int pop_lsb(uint64_t * x) {
+  int o = lsb64(*x);
+  *x &= *x - 1;
+  return o;
+}
+
+// xorshift64*, for tables generated at load time
+static inline uint64_t prng64(uint64_t * s) {
+  *s ^= *s >> 12;
+  *s ^= *s << 25;
+  *s ^= *s >> 27;
+  return *s * 2685821657736338717ULL;
+}
+
 bool liesOnSameDiag(unsigned int p1, unsigned int p2);
 
+// magic.c
+typedef struct {
+  uint64_t mask;
+  uint64_t magic;
+  uint64_t * attacks;
+  unsigned int shift;
+} Magic;
+
+extern Magic RookMagics[64];
+extern Magic BishopMagics[64];
+extern bool use_pext;
+
+#ifdef CHESS_HAS_PEXT
+uint64_t pext64(uint64_t x, uint64_t mask);
+#endif
+
+static inline unsigned int magic_index(const Magic * m, uint64_t occupied) {
+#ifdef CHESS_HAS_PEXT
+  if (use_pext) {
+    return (unsigned int)pext64(occupied, m->mask);
+  }
+#endif
+  return (unsigned int)(((occupied & m->mask) * m->magic) >> m->shift);
+}
+
+static inline uint64_t bishopAttacks(unsigned int p, uint64_t occupied) {
+  const Magic * m = &BishopMagics[p];
+  return m->attacks[magic_index(m, occupied)];
+}
+
+static inline uint64_t rookAttacks(unsigned int p, uint64_t occupied) {
+  const Magic * m = &RookMagics[p];
+  return m->attacks[magic_index(m, occupied)];
+}
+
+static inline uint64_t queenAttacks(unsigned int p, uint64_t occupied) {
+  return bishopAttacks(p, occupied) | rookAttacks(p, occupied);
+}
+
+void init_magics(void);
+
+// attacks.c
+extern uint64_t KnightAttacks[64];
+extern uint64_t KingAttacks[64];
+extern uint64_t PawnAttacks[2][64]; // [Color][p]: squares a pawn on p attacks
+extern uint64_t BetweenBB[64][64]; // squares strictly between, if aligned
+extern uint64_t LineBB[64][64]; // the whole line through both, if aligned
+
+void init_attacks(void);
+
+// zobrist.c
+extern uint64_t ZobristPiece[2][7][64];
+extern uint64_t ZobristCastling[2][4];
+extern uint64_t ZobristEnPassant[8];
+extern uint64_t ZobristSide;
+
+void init_zobrist(void);
+
+// chess.c
+typedef enum {
+  EMPTY,
+  PAWN,
+  KNIGHT,
+  BISHOP,
+  ROOK,
+  QUEEN,
+  KING
+} Piece;
+
+typedef enum {
+  WHITE,
+  BLACK
+} Color;
+
+typedef struct {
+  uint8_t piece; // Piece
+  uint8_t color; // Color
+} Square;
+
+typedef struct {
+  unsigned int fromRow : 3;
+  unsigned int fromCol : 3;
+  unsigned int toRow : 3;
+  unsigned int toCol : 3;
+  Piece toPiece; // relevant for promotions and to signify starting position
+} Move;
+
+// Moves made by the generator and the searches are packed into 16 bits:
+// bits 0-5 the origin square, 6-11 the destination, 12-13 the promoted piece
+// (less KNIGHT) and 14-15 the kind of move
+typedef uint16_t Move16;
+
+enum {
+  MOVE_NORMAL,
+  MOVE_PROMOTION,
+  MOVE_ENPASSANT,
+  MOVE_CASTLING
+};
+
+#define MOVE16(from, to, kind) ((Move16)((from) | ((to) << 6) | ((kind) << 14)))
+#define MOVE16_FROM(m) ((m) & 63)
+#define MOVE16_TO(m) (((m) >> 6) & 63)
+#define MOVE16_PROMOTED(m) ((Piece)(KNIGHT + (((m) >> 12) & 3)))
+#define MOVE16_KIND(m) ((m) >> 14)
+
+// No position has more than 218 legal moves
+#define MOVELIST_SIZE 256
+
+typedef struct {
+  Move16 moves[MOVELIST_SIZE];
+  int n;
+} MoveList;
+
+typedef struct {
+  Square board[8][8]; // mailbox, kept in step with the bitboards by setSquare()
+  uint64_t pieceBB[2][7]; // [Color][Piece], [.][EMPTY] unused
+  uint64_t colorBB[2];
+  uint64_t occupiedBB;
+  unsigned int WhiteKing : 6; // duplicately record the kings' positions
+  unsigned int BlackKing : 6;
+  unsigned int WhiteMayCastle : 2; // castling rights, encoded as by canCastle()
+  unsigned int BlackMayCastle : 2;
+  Move lastMove;
+  uint64_t key; // Zobrist key, maintained incrementally
+} Chessboard;
+
+// What make_move() needs to remember so that unmake_move() can restore the
+// board exactly, without copying the whole Chessboard
+typedef struct {
+  Square captured; // piece.EMPTY if nothing was captured
+  unsigned int WhiteKing : 6;
+  unsigned int BlackKing : 6;
+  unsigned int WhiteMayCastle : 2;
+  unsigned int BlackMayCastle : 2;
+  Move lastMove;
+  uint64_t key;
+} Undo;
+
+unsigned int p2row(unsigned int x);
+unsigned int p2col(unsigned int x);
+unsigned int rowcol2p(int r, int c);
+void setSquare(Chessboard * board, int row, int col, Piece P, Color C);
+void setCastlingRights(Chessboard * board, Color C, unsigned int rights);
+void blankBoard(Chessboard * board);
+void startingPosition(Chessboard * board);
+uint64_t enPassantKey(const Chessboard * board);
+void make_move(Chessboard * board, Move16 m, Undo * u);
+void unmake_move(Chessboard * board, Move16 m, const Undo * u);
+bool isKingInCheck(const Chessboard * board, Color kingColor);
+int generateMoves(const Chessboard * board, Color sideToMove, MoveList * list);
+int generateEvasions(const Chessboard * board, Color sideToMove, MoveList * list);
+bool givesCheck(const Chessboard * board, Color side, Move16 m);
+int generateChecks(const Chessboard * board, Color sideToMove, MoveList * list);
+int generateCaptures(const Chessboard * board, Color sideToMove, MoveList * list);
+int generateQuiets(const Chessboard * board, Color sideToMove, MoveList * list);
+bool hasLegalMove(const Chessboard * board, Color sideToMove);
+bool isCheckmate(const Chessboard * board, Color sideToMove);
+int material_score(const Chessboard * board, Color C);
+int isntValidBoard(const Chessboard * board, Color colorToMove);
+void move16_to_uci(Move16 m, char out[6]);
+int piece_square(const char * s, Piece * P);
+
+// Does the legal move m take a piece, or promote?
+static inline bool isCaptureOrPromotion(const Chessboard * board, Move16 m) {
+  const unsigned int to = MOVE16_TO(m);
+  return board->board[to >> 3][to & 7].piece != EMPTY ||
+    MOVE16_KIND(m) == MOVE_ENPASSANT || MOVE16_KIND(m) == MOVE_PROMOTION;
+}
+
+// fen.c
+#define FEN_MAX 100 // the longest FEN written, with its terminator
+
+const char * parse_fen(Chessboard * board, Color * sideToMove, const char * fen, int clocks[2]);
+void write_fen(const Chessboard * board, Color sideToMove, int halfmove, int fullmove, char * out);
+
+// san.c
+enum {
+  SAN_OK,
+  SAN_MALFORMED,
+  SAN_ILLEGAL,
+  SAN_AMBIGUOUS
+};
+
+int san2move16(const Chessboard * board, Color sideToMove, const char * san, Move16 * m);
+const char * san_error_message(int code);
+
+// chess.c: games, replayed move by move
+#define LONG_GAME 255
+
+// Errors replaying a game, beyond those of reading its moves
+enum {
+  GAME_TOO_LONG = SAN_AMBIGUOUS + 1,
+  GAME_LENGTHS,
+  GAME_FEN
+};
+
+// Four bits a piece: eight pawns, or ten of a piece after promotions
+typedef struct {
+  unsigned int P : 4;
+  unsigned int Q : 4;
+  unsigned int R : 4;
+  unsigned int N : 4;
+  unsigned int B_light : 4;
+  unsigned int B_dark : 4;
+  unsigned int bishop_pair : 1;
+} Material;
+
+typedef struct {
+  Chessboard Board;
+  Color sideToMove;
+  Move Moves[LONG_GAME][2];
+  Material material[2]; // [Color], kept up to date by play_move
+  uint16_t white_material[LONG_GAME];
+  uint16_t black_material[LONG_GAME];
+  unsigned int move : 8;
+  unsigned int whiteLostCastlingRights : 8;
+  unsigned int blackLostCastlingRights : 8;
+  unsigned int last_pawn_move : 8;
+} Game;
+
+void initialize_Game(Game * G);
+const char * initialize_Game_fen(Game * G, const char * fen);
+int play_san(Game * G, const char * san);
+int board2outcome(const Chessboard * board);
+
+static inline int thread_num(void) {
+#ifdef _OPENMP
+  return omp_get_thread_num();
+#else
+  return 0;
+#endif
+}
+
+// perft.c
+uint64_t perft(Chessboard * board, Color sideToMove, int depth);
+int divide(Chessboard * board, Color sideToMove, int depth, MoveList * list, uint64_t * nodes);
+
+// limits.c
+enum {
+  LIMIT_NONE,
+  LIMIT_NODES,
+  LIMIT_TIME,
+  LIMIT_INTERRUPT
+};
+
+// Searches report their nodes every LIMITS_PERIOD
+#define LIMITS_PERIOD 1024
+
+typedef struct {
+  uint64_t nodes; // counted so far, by all threads
+  uint64_t max_nodes; // 0 for no limit
+  double deadline; // by clock_seconds(), 0 for none
+  int out; // which budget is spent, else LIMIT_NONE
+} SearchLimits;
+
+double clock_seconds(void);
+void limits_init(SearchLimits * L, double max_nodes, double max_time_ms);
+int limits_spent(SearchLimits * L, uint64_t nodes);
+
+// mate.c
+#define MATE_MAX_MOVES 32
+
+// Transposition table entry for a position with the attacker to move. The
+// data packs a mating move, if proven, in bits 0-15; in bits 16-23 the number
+// of moves within which the side to move mates (0 if unknown); and in bits
+// 24-31 the number within which it cannot.
+typedef struct {
+  uint64_t check; // the key XOR data
+  uint64_t data;
+} MateEntry;
+
+typedef struct {
+  uint64_t nodes;
+  MateEntry * table; // NULL for no table
+  uint64_t mask; // table size less one, the size a power of two
+  int * stop; // shared by the threads of a parallel search, else NULL
+  SearchLimits * limits; // shared by all the threads, NULL for none
+  int skew; // where a lazy SMP helper starts each list of moves, else 0
+  bool checks_only; // the attacker must check with every move
+} MateSearch;
+
+uint64_t mate_table_size(double megabytes);
+
+int mate_search(MateSearch * S, int nThread, bool lazy, Chessboard * board, Color sideToMove, int n,
+                Move16 * line, int * len, int * depth);
+
+// pns.c
+#define PNS_MAX_PLIES 256
+
+int pn_search(Chessboard * board, Color sideToMove, uint64_t max_nodes, SearchLimits * limits,
+              Move16 * line, int * len, uint64_t * nodes);
+
+// search.c
+#define SEARCH_MAX_PLY 64
+#define SCORE_INF 32767
+#define SCORE_MATE 32000 // less the plies to mate
+
+typedef struct {
+  uint64_t nodes;
+  SearchLimits * limits; // NULL for none
+  Move16 pv[SEARCH_MAX_PLY][SEARCH_MAX_PLY]; // the principal variation from each ply
+  int pv_len[SEARCH_MAX_PLY];
+  Move16 prev_pv[SEARCH_MAX_PLY]; // the last iteration's, searched first
+  int prev_pv_len;
+  Move16 killers[SEARCH_MAX_PLY][2]; // quiet moves that last cut off at each ply
+  int32_t history[2][64][64]; // [Color][from][to]: how often a quiet move cut off, by depth
+} Search;
+
+int evaluate_position(const Chessboard * board, Color side);
+int search_best_move(Search * S, Chessboard * board, Color sideToMove, int depth,
+                     Move16 * line, int * len, int * score, int * depth_reached);
+
 #endif
@@ -0,0 +1,426 @@
+#include "chess.h"
+
+// Forsyth-Edwards Notation, e.g. the starting position is
+// rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1
+// The move counters, the halfmove clock and the fullmove number, may be
+// left off, when they are taken as 0 and 1.
+
+static Piece fenPiece(char x) {
+  switch (tolower((unsigned char)x)) {
+  case 'p':
+    return PAWN;
+  case 'n':
+    return KNIGHT;
+  case 'b':
+    return BISHOP;
+  case 'r':
+    return ROOK;
+  case 'q':
+    return QUEEN;
+  case 'k':
+    return KING;
+  }
+  return EMPTY;
+}
+
+// Sets up board from fen, and the move counters in clocks, unless NULL.
+// Returns NULL on success, else a description of what was wrong, so that
+// callers decide whether and how to error.
+const char * parse_fen(Chessboard * board, Color * sideToMove, const char * fen, int clocks[2]) {
+  blankBoard(board);
+  memset(&(board->lastMove), 0, sizeof(Move));
+  const char * s = fen;
+  while (isspace((unsigned char)*s)) {
+    ++s;
+  }
+
+  int kings[2] = {0};
+  int r = 7, c = 0;
+  for (; *s && !isspace((unsigned char)*s); ++s) {
+    if (*s == '/') {
+      if (c != 8) {
+        return "rank with other than 8 squares";
+      }
+      if (--r < 0) {
+        return "more than 8 ranks";
+      }
+      c = 0;
+      continue;
+    }
+    if (*s >= '1' && *s <= '8') {
+      c += *s - '0';
+      if (c > 8) {
+        return "rank with other than 8 squares";
+      }
+      continue;
+    }
+    Piece P = fenPiece(*s);
+    if (P == EMPTY || c > 7) {
+      return P == EMPTY ? "unknown piece" : "rank with other than 8 squares";
+    }
+    Color C = isupper((unsigned char)*s) ? WHITE : BLACK;
+    if (P == PAWN && (r == 0 || r == 7)) {
+      return "pawn on the first or last rank";
+    }
+    setSquare(board, r, c, P, C);
+    if (P == KING) {
+      ++kings[C];
+      if (C == WHITE) {
+        board->WhiteKing = rowcol2p(r, c);
+      } else {
+        board->BlackKing = rowcol2p(r, c);
+      }
+    }
+    ++c;
+  }
+  if (r != 0 || c != 8) {
+    return "fewer than 8 ranks";
+  }
+  if (kings[WHITE] != 1 || kings[BLACK] != 1) {
+    return "not exactly one king of each colour";
+  }
+
+  while (isspace((unsigned char)*s)) {
+    ++s;
+  }
+  if (*s != 'w' && *s != 'b') {
+    return "side to move not w or b";
+  }
+  *sideToMove = (*s == 'w') ? WHITE : BLACK;
+  ++s;
+
+  // Castling rights, checked against the kings and rooks actually present
+  while (isspace((unsigned char)*s)) {
+    ++s;
+  }
+  unsigned int rights[2] = {0, 0};
+  for (; *s && !isspace((unsigned char)*s); ++s) {
+    switch (*s) {
+    case 'K':
+      rights[WHITE] |= 1;
+      break;
+    case 'Q':
+      rights[WHITE] |= 2;
+      break;
+    case 'k':
+      rights[BLACK] |= 1;
+      break;
+    case 'q':
+      rights[BLACK] |= 2;
+      break;
+    case '-':
+      break;
+    default:
+      return "castling rights not from KQkq-";
+    }
+  }
+  for (int C = WHITE; C <= BLACK; ++C) {
+    int home = (C == WHITE) ? 0 : 7;
+    Square king = board->board[home][4];
+    Square hrook = board->board[home][7];
+    Square arook = board->board[home][0];
+    if (rights[C] && (king.piece != KING || king.color != C)) {
+      return "castling rights without the king on its square";
+    }
+    if (((rights[C] & 1) && (hrook.piece != ROOK || hrook.color != C)) ||
+        ((rights[C] & 2) && (arook.piece != ROOK || arook.color != C))) {
+      return "castling rights without the rook on its square";
+    }
+    setCastlingRights(board, C, rights[C]);
+  }
+
+  // En passant target square, recorded as the double pawn move that made it
+  while (isspace((unsigned char)*s)) {
+    ++s;
+  }
+  if (*s == '-') {
+    ++s;
+  } else if (*s) {
+    if (s[0] < 'a' || s[0] > 'h' || (s[1] != '3' && s[1] != '6')) {
+      return "en passant square not on the third or sixth rank";
+    }
+    int col = s[0] - 'a';
+    bool white_pushed = s[1] == '3';
+    if (white_pushed != (*sideToMove == BLACK)) {
+      return "en passant square for the side to move";
+    }
+    board->lastMove.fromCol = col;
+    board->lastMove.toCol = col;
+    board->lastMove.fromRow = white_pushed ? 1 : 6;
+    board->lastMove.toRow = white_pushed ? 3 : 4;
+    board->lastMove.toPiece = PAWN;
+    Square pushed = board->board[board->lastMove.toRow][col];
+    if (pushed.piece != PAWN || pushed.color != (white_pushed ? WHITE : BLACK)) {
+      return "en passant square without the pawn that passed it";
+    }
+    // the pawn passed over the square from its own, both since left empty
+    if (board->board[white_pushed ? 2 : 5][col].piece != EMPTY ||
+        board->board[board->lastMove.fromRow][col].piece != EMPTY) {
+      return "en passant square, or the square the pawn left, not empty";
+    }
+    s += 2;
+  }
+  if (*s && !isspace((unsigned char)*s)) {
+    return "en passant square not a square or '-'";
+  }
+
+  int counters[2] = {0, 1};
+  for (int i = 0; i < 2; ++i) {
+    while (isspace((unsigned char)*s)) {
+      ++s;
+    }
+    if (!*s) {
+      break;
+    }
+    if (!isdigit((unsigned char)*s)) {
+      return "move counters not numbers";
+    }
+    long x = 0;
+    for (; isdigit((unsigned char)*s); ++s) {
+      x = 10 * x + (*s - '0');
+      if (x > 1000000) {
+        return "move counters too large";
+      }
+    }
+    counters[i] = (int)x;
+  }
+  while (isspace((unsigned char)*s)) {
+    ++s;
+  }
+  if (*s) {
+    return "more than six fields";
+  }
+  if (counters[1] < 1) {
+    return "fullmove number less than 1";
+  }
+  if (clocks) {
+    clocks[0] = counters[0];
+    clocks[1] = counters[1];
+  }
+
+  if (*sideToMove == BLACK) {
+    board->key ^= ZobristSide;
+  }
+  board->key ^= enPassantKey(board);
+  if (isntValidBoard(board, *sideToMove)) {
+    return "side not to move is in check";
+  }
+  return NULL;
+}
+
+// The square passed by the pawn that last moved two squares, if that was
+// the last move, else -1
+static int en_passant_square(const Chessboard * board) {
+  Move m = board->lastMove;
+  if (m.toPiece != PAWN || m.fromCol != m.toCol ||
+      !((m.fromRow == 1 && m.toRow == 3) || (m.fromRow == 6 && m.toRow == 4))) {
+    return -1;
+  }
+  Square pushed = board->board[m.toRow][m.toCol];
+  if (pushed.piece != PAWN || pushed.color != (m.fromRow == 1 ? WHITE : BLACK)) {
+    return -1;
+  }
+  return rowcol2p((m.fromRow + m.toRow) / 2, m.toCol);
+}
+
+// The FEN of the position with the given move counters, into out, which
+// must have room for FEN_MAX characters. As the standard has it, any en
+// passant square is given whether or not a pawn could take there.
+void write_fen(const Chessboard * board, Color sideToMove, int halfmove, int fullmove, char * out) {
+  static const char * letters = " pnbrqk";
+  char * o = out;
+  for (int r = 7; r >= 0; --r) {
+    int empty = 0;
+    for (int c = 0; c < 8; ++c) {
+      Square sq = board->board[r][c];
+      if (sq.piece == EMPTY) {
+        ++empty;
+        continue;
+      }
+      if (empty) {
+        *o++ = '0' + empty;
+        empty = 0;
+      }
+      *o++ = sq.color == WHITE ? toupper(letters[sq.piece]) : letters[sq.piece];
+    }
+    if (empty) {
+      *o++ = '0' + empty;
+    }
+    if (r) {
+      *o++ = '/';
+    }
+  }
+  *o++ = ' ';
+  *o++ = sideToMove == WHITE ? 'w' : 'b';
+  *o++ = ' ';
+  const char * castling = o;
+  if (board->WhiteMayCastle & 1) {
+    *o++ = 'K';
+  }
+  if (board->WhiteMayCastle & 2) {
+    *o++ = 'Q';
+  }
+  if (board->BlackMayCastle & 1) {
+    *o++ = 'k';
+  }
+  if (board->BlackMayCastle & 2) {
+    *o++ = 'q';
+  }
+  if (o == castling) {
+    *o++ = '-';
+  }
+  *o++ = ' ';
+  int ep = en_passant_square(board);
+  if (ep < 0) {
+    *o++ = '-';
+  } else {
+    *o++ = 'a' + p2col(ep);
+    *o++ = '1' + p2row(ep);
+  }
+  snprintf(o, FEN_MAX - (o - out), " %d %d", halfmove, fullmove);
+}
+
+// The pieces of colour C, as is_checkmate() takes them: "Ke1", "e2"
+static SEXP board2pieces(const Chessboard * board, Color C) {
+  static const char * letters = "  NBRQK";
+  int n = 0;
+  for (int p = 0; p < 64; ++p) {
+    Square sq = board->board[p2row(p)][p2col(p)];
+    n += sq.piece != EMPTY && sq.color == C;
+  }
+  SEXP ans = PROTECT(allocVector(STRSXP, n));
+  int j = 0;
+  for (int p = 0; p < 64; ++p) {
+    Square sq = board->board[p2row(p)][p2col(p)];
+    if (sq.piece == EMPTY || sq.color != C) {
+      continue;
+    }
+    char s[4], * o = s;
+    if (sq.piece != PAWN) {
+      *o++ = letters[sq.piece];
+    }
+    *o++ = 'a' + p2col(p);
+    *o++ = '1' + p2row(p);
+    *o = '\0';
+    SET_STRING_ELT(ans, j++, mkChar(s));
+  }
+  UNPROTECT(1);
+  return ans;
+}
+
+// Positions from a character vector of FEN: a list of the pieces of each
+// side, the side to move, the castling rights, the en passant square and
+// the move counters, one element per position.
+SEXP C_ReadFen(SEXP Fen) {
+  if (!isString(Fen)) {
+    error("`fen` must be a character vector.");
+  }
+  const R_xlen_t N = xlength(Fen);
+  SEXP ans = PROTECT(allocVector(VECSXP, 7));
+  SEXP X = PROTECT(allocVector(VECSXP, N));
+  SEXP Y = PROTECT(allocVector(VECSXP, N));
+  SEXP WhiteToMove = PROTECT(allocVector(LGLSXP, N));
+  SEXP Castling = PROTECT(allocVector(STRSXP, N));
+  SEXP EnPassant = PROTECT(allocVector(STRSXP, N));
+  SEXP Halfmove = PROTECT(allocVector(INTSXP, N));
+  SEXP Fullmove = PROTECT(allocVector(INTSXP, N));
+  for (R_xlen_t i = 0; i < N; ++i) {
+    SEXP s = STRING_ELT(Fen, i);
+    if (s == NA_STRING) {
+      error("FEN %lld is NA.", (long long)(i + 1));
+    }
+    Chessboard Board;
+    Color sideToMove = WHITE;
+    int clocks[2];
+    const char * msg = parse_fen(&Board, &sideToMove, CHAR(s), clocks);
+    if (msg) {
+      error("Invalid FEN %lld, '%s': %s.", (long long)(i + 1), CHAR(s), msg);
+    }
+    SET_VECTOR_ELT(X, i, board2pieces(&Board, WHITE));
+    SET_VECTOR_ELT(Y, i, board2pieces(&Board, BLACK));
+    LOGICAL(WhiteToMove)[i] = sideToMove == WHITE;
+    // the fields of the FEN as written back out
+    char fen[FEN_MAX];
+    write_fen(&Board, sideToMove, clocks[0], clocks[1], fen);
+    char * castling = strchr(fen, ' ') + 3;
+    char * ep = strchr(castling, ' ') + 1;
+    *strchr(ep, ' ') = '\0';
+    ep[-1] = '\0';
+    SET_STRING_ELT(Castling, i, mkChar(castling));
+    SET_STRING_ELT(EnPassant, i, ep[0] == '-' ? NA_STRING : mkChar(ep));
+    INTEGER(Halfmove)[i] = clocks[0];
+    INTEGER(Fullmove)[i] = clocks[1];
+  }
+  SET_VECTOR_ELT(ans, 0, X);
+  SET_VECTOR_ELT(ans, 1, Y);
+  SET_VECTOR_ELT(ans, 2, WhiteToMove);
+  SET_VECTOR_ELT(ans, 3, Castling);
+  SET_VECTOR_ELT(ans, 4, EnPassant);
+  SET_VECTOR_ELT(ans, 5, Halfmove);
+  SET_VECTOR_ELT(ans, 6, Fullmove);
+  UNPROTECT(8);
+  return ans;
+}
+
+// The inverse of C_ReadFen(): FEN from the fields of each position. What is
+// written is read back, so that only valid FEN comes out.
+SEXP C_WriteFen(SEXP X, SEXP Y, SEXP WhiteToMove, SEXP Castling, SEXP EnPassant, SEXP Halfmove,
+                SEXP Fullmove) {
+  if (!isNewList(X) || !isNewList(Y)) {
+    error("`x` and `y` must be lists.");
+  }
+  const R_xlen_t N = xlength(X);
+  if (xlength(Y) != N || !isLogical(WhiteToMove) || xlength(WhiteToMove) != N ||
+      !isString(Castling) || xlength(Castling) != N || !isString(EnPassant) || xlength(EnPassant) != N ||
+      !isInteger(Halfmove) || xlength(Halfmove) != N || !isInteger(Fullmove) || xlength(Fullmove) != N) {
+    error("Every field of the positions must have one value per position.");
+  }
+  SEXP ans = PROTECT(allocVector(STRSXP, N));
+  for (R_xlen_t i = 0; i < N; ++i) {
+    const int white_to_move = LOGICAL(WhiteToMove)[i];
+    const int halfmove = INTEGER(Halfmove)[i];
+    const int fullmove = INTEGER(Fullmove)[i];
+    SEXP castling = STRING_ELT(Castling, i);
+    SEXP ep = STRING_ELT(EnPassant, i);
+    if (white_to_move == NA_LOGICAL || castling == NA_STRING || halfmove == NA_INTEGER ||
+        fullmove == NA_INTEGER || halfmove < 0 || halfmove > 1000000 || fullmove > 1000000 ||
+        strlen(CHAR(castling)) > 4 || (ep != NA_STRING && strlen(CHAR(ep)) > 2)) {
+      error("Position %lld: missing or out-of-range fields.", (long long)(i + 1));
+    }
+    Chessboard Board;
+    blankBoard(&Board);
+    memset(&(Board.lastMove), 0, sizeof(Move));
+    for (int C = WHITE; C <= BLACK; ++C) {
+      SEXP pieces = VECTOR_ELT(C == WHITE ? X : Y, i);
+      if (!isString(pieces)) {
+        error("Position %lld: the pieces must be character vectors.", (long long)(i + 1));
+      }
+      for (R_xlen_t j = 0; j < xlength(pieces); ++j) {
+        Piece P;
+        int p = STRING_ELT(pieces, j) == NA_STRING ? -1 : piece_square(CHAR(STRING_ELT(pieces, j)), &P);
+        if (p < 0) {
+          error("Position %lld: malformed piece.", (long long)(i + 1));
+        }
+        setSquare(&Board, p2row(p), p2col(p), P, (Color)C);
+      }
+    }
+    // the castling rights and en passant square go in as they are, to be
+    // checked with the rest by reading back
+    char placement[FEN_MAX];
+    write_fen(&Board, white_to_move ? WHITE : BLACK, halfmove, fullmove, placement);
+    *strchr(placement, ' ') = '\0';
+    char fen[2 * FEN_MAX];
+    snprintf(fen, sizeof(fen), "%s %c %s %s %d %d", placement, white_to_move ? 'w' : 'b',
+             CHAR(castling), ep == NA_STRING ? "-" : CHAR(ep), halfmove, fullmove);
+    Color sideToMove;
+    const char * msg = parse_fen(&Board, &sideToMove, fen, NULL);
+    if (msg) {
+      error("Position %lld, '%s': %s.", (long long)(i + 1), fen, msg);
+    }
+    // written again, the castling rights in their usual order
+    write_fen(&Board, sideToMove, halfmove, fullmove, fen);
+    SET_STRING_ELT(ans, i, mkChar(fen));
+  }
+  UNPROTECT(1);
+  return ans;
+}
@@ -7,17 +7,39 @@
    Check these declarations against the C/Fortran source code.
 */
 
+void init_magics(void);
+void init_attacks(void);
+void init_zobrist(void);
+
 /* .Call calls */
+extern SEXP C_BestMove(SEXP, SEXP, SEXP, SEXP, SEXP, SEXP);
 extern SEXP C_canEnPassant(SEXP, SEXP, SEXP, SEXP, SEXP);
-extern SEXP C_CheckmateInN(SEXP, SEXP, SEXP);
+extern SEXP C_CheckmateInN(SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP);
 extern SEXP C_game2outcome(SEXP, SEXP);
+extern SEXP C_games2outcome(SEXP, SEXP, SEXP);
 extern SEXP C_isCheckmate(SEXP, SEXP, SEXP, SEXP, SEXP);
+extern SEXP C_isCheckmateFen(SEXP, SEXP);
+extern SEXP C_isCheckmateMany(SEXP, SEXP, SEXP, SEXP, SEXP, SEXP);
+extern SEXP C_perft(SEXP, SEXP, SEXP);
+extern SEXP C_ReadFen(SEXP);
+extern SEXP C_ReadPgn(SEXP, SEXP, SEXP);
+extern SEXP C_SolveMate(SEXP, SEXP, SEXP, SEXP, SEXP);
+extern SEXP C_WriteFen(SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP);
 
 static const R_CallMethodDef CallEntries[] = {
+    {"C_BestMove",     (DL_FUNC) &C_BestMove,     6},
     {"C_canEnPassant", (DL_FUNC) &C_canEnPassant, 5},
-    {"C_CheckmateInN", (DL_FUNC) &C_CheckmateInN, 3},
+    {"C_CheckmateInN", (DL_FUNC) &C_CheckmateInN, 9},
     {"C_game2outcome", (DL_FUNC) &C_game2outcome, 2},
+    {"C_games2outcome", (DL_FUNC) &C_games2outcome, 3},
     {"C_isCheckmate",  (DL_FUNC) &C_isCheckmate,  5},
+    {"C_isCheckmateFen", (DL_FUNC) &C_isCheckmateFen, 2},
+    {"C_isCheckmateMany", (DL_FUNC) &C_isCheckmateMany, 6},
+    {"C_perft",        (DL_FUNC) &C_perft,        3},
+    {"C_ReadFen",      (DL_FUNC) &C_ReadFen,      1},
+    {"C_ReadPgn",      (DL_FUNC) &C_ReadPgn,      3},
+    {"C_SolveMate",    (DL_FUNC) &C_SolveMate,    5},
+    {"C_WriteFen",     (DL_FUNC) &C_WriteFen,     7},
     {NULL, NULL, 0}
 };
 
@@ -25,4 +47,7 @@ void R_init_chesschess(DllInfo *dll)
 {
     R_registerRoutines(dll, NULL, CallEntries, NULL, NULL);
     R_useDynamicSymbols(dll, FALSE);
+    init_magics();
+    init_attacks();
+    init_zobrist();
 }
@@ -0,0 +1,65 @@
+#include "chess.h"
+#include <time.h>
+
+// Budgets for the searches: nodes, time and the user's patience. A search
+// reports its nodes in batches through limits_spent(), from any thread;
+// once that returns nonzero every thread of the search unwinds.
+
+double clock_seconds(void) {
+  struct timespec ts;
+  timespec_get(&ts, TIME_UTC);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+// Nonpositive or infinite budgets are no budget at all
+void limits_init(SearchLimits * L, double max_nodes, double max_time_ms) {
+  L->nodes = 0;
+  L->max_nodes = (max_nodes > 0 && max_nodes < 1.8e19) ? (uint64_t)max_nodes : 0;
+  L->deadline = (max_time_ms > 0 && R_FINITE(max_time_ms)) ? clock_seconds() + max_time_ms / 1000 : 0;
+  L->out = LIMIT_NONE;
+}
+
+static void check_interrupt(void * dummy) {
+  (void)dummy;
+  R_CheckUserInterrupt();
+}
+
+// R_CheckUserInterrupt() would jump straight out of the search, leaving
+// threads running and memory allocated, so it is run at the top level and
+// only asked whether it would have
+static bool interrupt_pending(void) {
+  return !R_ToplevelExec(check_interrupt, NULL);
+}
+
+// Count another batch of nodes against L. Which budget, if any, is spent?
+int limits_spent(SearchLimits * L, uint64_t nodes) {
+  int out;
+#pragma omp atomic read
+  out = L->out;
+  if (out) {
+    return out;
+  }
+  uint64_t total;
+#pragma omp atomic capture
+  total = L->nodes += nodes;
+  if (L->max_nodes && total >= L->max_nodes) {
+    out = LIMIT_NODES;
+  } else if (L->deadline && clock_seconds() >= L->deadline) {
+    out = LIMIT_TIME;
+  } else {
+    // R may only be called from its own thread, the master of any team
+#ifdef _OPENMP
+    bool main_thread = omp_get_thread_num() == 0;
+#else
+    bool main_thread = true;
+#endif
+    if (main_thread && interrupt_pending()) {
+      out = LIMIT_INTERRUPT;
+    }
+  }
+  if (out) {
+#pragma omp atomic write
+    L->out = out;
+  }
+  return out;
+}
@@ -0,0 +1,118 @@
+#include "chess.h"
+
+// Sliding piece attack tables ('fancy' magic bitboards).
+// Every square has a mask of the relevant occupancy (the rays, less the
+// board edge) and an index function mapping any occupancy to a slot holding
+// the attack set. The index is either a multiply-and-shift by a magic number
+// found at load time, or PEXT where the CPU has BMI2. The tables are filled
+// according to whichever index is in use.
+
+Magic RookMagics[64];
+Magic BishopMagics[64];
+bool use_pext = false;
+
+static uint64_t RookTable[0x19000];  // 102400 = sum over squares of 2^bits
+static uint64_t BishopTable[0x1480]; //   5248
+
+static const int RookDeltas[4][2] = {{1, 0}, {-1, 0}, {0, 1}, {0, -1}};
+static const int BishopDeltas[4][2] = {{1, 1}, {1, -1}, {-1, 1}, {-1, -1}};
+
+#ifdef CHESS_HAS_PEXT
+__attribute__((target("bmi2")))
+uint64_t pext64(uint64_t x, uint64_t mask) {
+  return _pext_u64(x, mask);
+}
+#endif
+
+static bool cpu_has_bmi2(void) {
+#ifdef CHESS_HAS_PEXT
+  __builtin_cpu_init();
+  return __builtin_cpu_supports("bmi2");
+#else
+  return false;
+#endif
+}
+
+// attacks by walking each ray until (and including) the first blocker;
+// only used to fill the tables
+static uint64_t ray_attacks(const int deltas[4][2], int p, uint64_t occupied) {
+  uint64_t o = 0;
+  for (int d = 0; d < 4; ++d) {
+    int r = (p >> 3) + deltas[d][0];
+    int c = (p & 7) + deltas[d][1];
+    while (r >= 0 && r < 8 && c >= 0 && c < 8) {
+      uint64_t b = BB((r << 3) + c);
+      o |= b;
+      if (occupied & b) {
+        break;
+      }
+      r += deltas[d][0];
+      c += deltas[d][1];
+    }
+  }
+  return o;
+}
+
+static void init_slider(Magic magics[64], uint64_t * table, const int deltas[4][2]) {
+  static uint64_t occupancy[4096];
+  static uint64_t reference[4096];
+  static int epoch[4096];
+  int attempt = 0;
+  uint64_t seed = 0x9E3779B97F4A7C15ULL;
+  memset(epoch, 0, sizeof(epoch));
+
+  uint64_t * attacks = table;
+  for (int p = 0; p < 64; ++p) {
+    Magic * m = &magics[p];
+    // edges are irrelevant unless the piece is on them
+    uint64_t rank_edges = (0xFFULL | (0xFFULL << 56)) & ~(0xFFULL << (p & 56));
+    uint64_t file_edges = (0x0101010101010101ULL | 0x8080808080808080ULL) & ~(0x0101010101010101ULL << (p & 7));
+    m->mask = ray_attacks(deltas, p, 0) & ~(rank_edges | file_edges);
+    m->shift = 64 - popcount64(m->mask);
+    m->attacks = attacks;
+
+    // Carry-Rippler trick to enumerate every subset of the mask
+    int size = 0;
+    uint64_t b = 0;
+    do {
+      occupancy[size] = b;
+      reference[size] = ray_attacks(deltas, p, b);
+      ++size;
+      b = (b - m->mask) & m->mask;
+    } while (b);
+
+    if (use_pext) {
+      m->magic = 0;
+      for (int i = 0; i < size; ++i) {
+        m->attacks[magic_index(m, occupancy[i])] = reference[i];
+      }
+      attacks += size;
+      continue;
+    }
+
+    // Try sparse random numbers until one maps every occupancy to a slot
+    // without destructive collisions
+    for (int i = 0; i < size; ) {
+      do {
+        m->magic = prng64(&seed) & prng64(&seed) & prng64(&seed);
+      } while (popcount64((m->magic * m->mask) >> 56) < 6);
+      ++attempt;
+      for (i = 0; i < size; ++i) {
+        unsigned int idx = (unsigned int)(((occupancy[i] & m->mask) * m->magic) >> m->shift);
+        if (epoch[idx] < attempt) {
+          epoch[idx] = attempt;
+          m->attacks[idx] = reference[i];
+        } else if (m->attacks[idx] != reference[i]) {
+          break;
+        }
+      }
+    }
+    attacks += size;
+  }
+}
+
+void init_magics(void) {
+  use_pext = cpu_has_bmi2();
+  init_slider(RookMagics, RookTable, RookDeltas);
+  init_slider(BishopMagics, BishopTable, BishopDeltas);
+}
@@ -0,0 +1,354 @@
+#include "chess.h"
+
+// Mate search as an AND/OR tree. The attacker (OR) needs one move after
+// which every defence (AND) still loses: a node is decided by the first
+// mating move, or by the first refutation, and the rest are never searched.
+// n counts the attacker's moves, so mate in n is 2n - 1 plies.
+
+static bool defend(MateSearch * S, Chessboard * board, Color side, int n);
+
+// With several threads each has its own MateSearch and they share a stop
+// flag, so that the first to find a mate can call the others off; and all
+// searches stop when their budget is spent. A search that has been stopped
+// returns false all the way up and stores nothing.
+static inline bool stopped(const MateSearch * S) {
+  int o = 0;
+  if (S->stop) {
+#pragma omp atomic read
+    o = *S->stop;
+  }
+  if (!o && S->limits) {
+#pragma omp atomic read
+    o = S->limits->out;
+  }
+  return o;
+}
+
+// Count a node, and say whether to stop
+static inline bool stop_at_node(MateSearch * S) {
+  if ((++S->nodes & (LIMITS_PERIOD - 1)) == 0 && S->limits) {
+    limits_spent(S->limits, LIMITS_PERIOD);
+  }
+  return stopped(S);
+}
+
+// This thread's search, of the nThread in S
+static inline MateSearch * own_search(MateSearch * S) {
+#ifdef _OPENMP
+  return &S[omp_get_thread_num()];
+#else
+  return S;
+#endif
+}
+
+// The largest power of two number of entries that fits in the given size
+uint64_t mate_table_size(double megabytes) {
+  double entries = megabytes * 1048576 / sizeof(MateEntry);
+  uint64_t o = 1;
+  if (!(entries >= 1)) {
+    return 0;
+  }
+  while (o <= entries / 2 && o < ((uint64_t)1 << 40)) {
+    o <<= 1;
+  }
+  return o;
+}
+
+// Only attacker nodes are stored: a defender node is settled by its children,
+// which are. An entry keeps the deepest bound either way; on a clash of keys
+// the newer position wins.
+//
+// The table may be shared by all the threads, and is read and written
+// without locks. Each entry is two words, the data and the key XOR the
+// data, so an entry torn by two threads writing at once no longer matches
+// its key and is merely a miss.
+#define MATE_DATA(move, proven, disproven) \
+  ((uint64_t)(move) | ((uint64_t)(proven) << 16) | ((uint64_t)(disproven) << 24))
+#define MATE_DATA_MOVE(d) ((Move16)((d) & 0xffff))
+#define MATE_DATA_PROVEN(d) ((int)(((d) >> 16) & 0xff))
+#define MATE_DATA_DISPROVEN(d) ((int)(((d) >> 24) & 0xff))
+
+static bool probe(const MateSearch * S, uint64_t key, uint64_t * data) {
+  const MateEntry * e = &S->table[key & S->mask];
+  uint64_t check, d;
+#pragma omp atomic read
+  check = e->check;
+#pragma omp atomic read
+  d = e->data;
+  if ((check ^ d) != key) {
+    return false;
+  }
+  *data = d;
+  return true;
+}
+
+static void store(MateSearch * S, uint64_t key, int n, bool mates, Move16 move) {
+  MateEntry * e = &S->table[key & S->mask];
+  uint64_t d;
+  Move16 m = 0;
+  int proven = 0, disproven = 0;
+  if (probe(S, key, &d)) {
+    m = MATE_DATA_MOVE(d);
+    proven = MATE_DATA_PROVEN(d);
+    disproven = MATE_DATA_DISPROVEN(d);
+  }
+  if (mates) {
+    if (proven == 0 || n < proven) {
+      proven = n;
+      m = move;
+    }
+  } else if (n > disproven) {
+    disproven = n;
+  }
+  d = MATE_DATA(m, proven, disproven);
+#pragma omp atomic write
+  e->check = key ^ d;
+#pragma omp atomic write
+  e->data = d;
+}
+
+// Can side, to move, mate within n moves? If so *best is a mating move.
+static bool attack(MateSearch * S, Chessboard * board, Color side, int n, Move16 * best) {
+  if (stop_at_node(S)) {
+    return false;
+  }
+  uint64_t d;
+  if (S->table && probe(S, board->key, &d)) {
+    const int proven = MATE_DATA_PROVEN(d);
+    if (proven && proven <= n) {
+      *best = MATE_DATA_MOVE(d);
+      return true;
+    }
+    if (MATE_DATA_DISPROVEN(d) >= n) {
+      return false;
+    }
+  }
+  const Color other = (side == WHITE) ? BLACK : WHITE;
+  bool mates = false;
+
+  // Checks first, and with one move left nothing else can mate; nor, if
+  // the search is for checks only, at all. The other moves come after.
+  MoveList list;
+  int nm = generateChecks(board, side, &list);
+  for (int pass = 0; !mates && pass < 2; ++pass) {
+    if (pass == 1) {
+      if (n <= 1 || S->checks_only) {
+        break;
+      }
+      nm = generateMoves(board, side, &list);
+    }
+    for (int i = 0; i < nm; ++i) {
+      Move16 m = list.moves[S->skew ? (i + S->skew) % nm : i];
+      if (pass == 1 && givesCheck(board, side, m)) {
+        continue; // searched already
+      }
+      Undo u;
+      make_move(board, m, &u);
+      mates = defend(S, board, other, n);
+      unmake_move(board, m, &u);
+      if (mates) {
+        *best = m;
+        break;
+      }
+    }
+  }
+  if (S->table && !stopped(S)) {
+    store(S, board->key, n, mates, mates ? *best : 0);
+  }
+  return mates;
+}
+
+// side has just been moved against, with the attacker's nth move. Does every
+// defence lose within the attacker's remaining n - 1 moves?
+static bool defend(MateSearch * S, Chessboard * board, Color side, int n) {
+  if (stop_at_node(S)) {
+    return false;
+  }
+  if (n <= 1) {
+    return isCheckmate(board, side);
+  }
+  // the defender is nearly always in check, so this is mostly evasions
+  MoveList list;
+  int nm = generateMoves(board, side, &list);
+  if (nm == 0) {
+    return isKingInCheck(board, side); // stalemate is no mate
+  }
+  const Color other = (side == WHITE) ? BLACK : WHITE;
+  for (int i = 0; i < nm; ++i) {
+    Undo u;
+    Move16 reply;
+    make_move(board, list.moves[i], &u);
+    bool mated = attack(S, board, other, n - 1, &reply);
+    unmake_move(board, list.moves[i], &u);
+    if (!mated) {
+      return false; // refuted
+    }
+  }
+  return true;
+}
+
+// attack() with the root moves shared among nThread threads, dynamically
+// since some moves take far longer to refute than others. The first mate
+// found stops the rest.
+static bool root_attack(MateSearch * S, int nThread, Chessboard * board, Color side, int n, Move16 * best) {
+  if (nThread <= 1) {
+    return attack(S, board, side, n, best);
+  }
+  MoveList list;
+  int nm = generateMoves(board, side, &list);
+  const Color other = (side == WHITE) ? BLACK : WHITE;
+  int stop = 0;
+  int found = -1;
+  for (int t = 0; t < nThread; ++t) {
+    S[t].stop = &stop;
+  }
+#pragma omp parallel for num_threads(nThread) schedule(dynamic)
+  for (int i = 0; i < nm; ++i) {
+    MateSearch * T = own_search(S);
+    if (stopped(T)) {
+      continue;
+    }
+    Chessboard b = *board;
+    Undo u;
+    make_move(&b, list.moves[i], &u);
+    // a stopped search never claims a mate, so this one is sound
+    if (((n > 1 && !T->checks_only) || isKingInCheck(&b, other)) &&
+        defend(T, &b, other, n)) {
+#pragma omp critical(chesschess_mate_found)
+      {
+        if (found < 0) {
+          found = i;
+        }
+      }
+#pragma omp atomic write
+      stop = 1;
+    }
+  }
+  for (int t = 0; t < nThread; ++t) {
+    S[t].stop = NULL;
+  }
+  if (found < 0) {
+    return false;
+  }
+  *best = list.moves[found];
+  return true;
+}
+
+// The fewest moves, at most n, in which side can mate, deepening one move at
+// a time: 0 if there is no mate within n, -1 if the budget ran out first.
+// *depth is the number of moves searched in full.
+static int shortest_mate(MateSearch * S, int nThread, Chessboard * board, Color side, int n,
+                         Move16 * best, int * depth) {
+  *depth = 0;
+  for (int k = 1; k <= n; ++k) {
+    if (root_attack(S, nThread, board, side, k, best)) {
+      *depth = k;
+      return k;
+    }
+    if (stopped(S)) {
+      return -1;
+    }
+    *depth = k;
+  }
+  return 0;
+}
+
+// Lazy SMP: every thread searches the whole tree, sharing the table. The
+// main thread deepens one move at a time and its answer is the answer; the
+// helpers, half of them a move deeper and each taking the moves in a
+// different order, fill the table ahead of it and stop when it is done.
+static int lazy_smp(MateSearch * S, int nThread, Chessboard * board, Color side, int n,
+                    Move16 * best, int * depth) {
+  int stop = 0;
+  int k = 0;
+  for (int t = 1; t < nThread; ++t) {
+    S[t].stop = &stop;
+    S[t].skew = 3 * t;
+  }
+#pragma omp parallel num_threads(nThread)
+  {
+    MateSearch * T = own_search(S);
+    Chessboard b = *board;
+    if (T == S) {
+      k = shortest_mate(T, 1, &b, side, n, best, depth);
+#pragma omp atomic write
+      stop = 1;
+    } else {
+      Move16 m;
+      for (int d = 1 + (T - S) % 2; d <= n && !stopped(T); ++d) {
+        attack(T, &b, side, d, &m);
+      }
+    }
+  }
+  for (int t = 1; t < nThread; ++t) {
+    S[t].stop = NULL;
+    S[t].skew = 0;
+  }
+  return k;
+}
+
+// Once a mate in k is known, follow it: the attacker mates as quickly as it
+// can and the defender holds out as long as it can. The defender's replies
+// are shared among the threads.
+static int mating_line(MateSearch * S, int nThread, Chessboard * board, Color side, int k, Move16 * line) {
+  Undo undo[2 * MATE_MAX_MOVES];
+  int len = 0;
+  Color attacker = side;
+  Color defender = (side == WHITE) ? BLACK : WHITE;
+  Move16 m;
+  while (k > 0 && root_attack(S, nThread, board, attacker, k, &m)) {
+    line[len] = m;
+    make_move(board, m, &undo[len++]);
+    if (!hasLegalMove(board, defender)) {
+      break;
+    }
+    MoveList list;
+    int nm = generateMoves(board, defender, &list);
+    int mates_in[MOVELIST_SIZE];
+#pragma omp parallel for num_threads(nThread) schedule(dynamic)
+    for (int i = 0; i < nm; ++i) {
+      Chessboard b = *board;
+      Undo u;
+      Move16 reply;
+      int depth;
+      make_move(&b, list.moves[i], &u);
+      mates_in[i] = shortest_mate(own_search(S), 1, &b, attacker, k - 1, &reply, &depth);
+    }
+    if (stopped(S)) {
+      break; // out of budget: the line stops short
+    }
+    int longest = 0;
+    Move16 stubbornest = list.moves[0];
+    for (int i = 0; i < nm; ++i) {
+      if (mates_in[i] > longest) {
+        longest = mates_in[i];
+        stubbornest = list.moves[i];
+      }
+    }
+    line[len] = stubbornest;
+    make_move(board, stubbornest, &undo[len++]);
+    k = longest;
+  }
+  for (int i = len - 1; i >= 0; --i) {
+    unmake_move(board, line[i], &undo[i]);
+  }
+  return len;
+}
+
+// Can the side to move mate within n moves? S holds one search per thread,
+// which split the root moves between them or, if lazy, search by lazy SMP.
+// Returns the number of moves of the shortest mate (0 if none, -1 if the
+// budget ran out before it was known), and the line, of at most 2n - 1
+// plies, in line[0..*len). *depth is the number of moves searched in full.
+int mate_search(MateSearch * S, int nThread, bool lazy, Chessboard * board, Color sideToMove, int n,
+                Move16 * line, int * len, int * depth) {
+  Move16 best;
+  *len = 0;
+  int k = (lazy && nThread > 1) ?
+    lazy_smp(S, nThread, board, sideToMove, n, &best, depth) :
+    shortest_mate(S, nThread, board, sideToMove, n, &best, depth);
+  if (k > 0) {
+    *len = mating_line(S, nThread, board, sideToMove, k, line);
+  }
+  return k;
+}
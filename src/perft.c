@@ -0,0 +1,75 @@
+#include "chess.h"
+
+// Perft: the number of leaf nodes of the legal move tree to a given depth.
+// Comparing against published counts checks the move generator and
+// make/unmake; timing it measures their throughput.
+
+uint64_t perft(Chessboard * board, Color sideToMove, int depth) {
+  MoveList list;
+  int n = generateMoves(board, sideToMove, &list);
+  if (depth <= 1) {
+    // the generator only emits legal moves, so the last ply needn't be made
+    return depth == 1 ? (uint64_t)n : 1;
+  }
+  const Color other = (sideToMove == WHITE) ? BLACK : WHITE;
+  uint64_t o = 0;
+  for (int i = 0; i < n; ++i) {
+    Undo u;
+    make_move(board, list.moves[i], &u);
+    o += perft(board, other, depth - 1);
+    unmake_move(board, list.moves[i], &u);
+  }
+  return o;
+}
+
+// perft of each move from the root: list->moves[i] leads to nodes[i]
+int divide(Chessboard * board, Color sideToMove, int depth, MoveList * list, uint64_t * nodes) {
+  int n = generateMoves(board, sideToMove, list);
+  const Color other = (sideToMove == WHITE) ? BLACK : WHITE;
+  for (int i = 0; i < n; ++i) {
+    Undo u;
+    make_move(board, list->moves[i], &u);
+    nodes[i] = perft(board, other, depth - 1);
+    unmake_move(board, list->moves[i], &u);
+  }
+  return n;
+}
+
+SEXP C_perft(SEXP Fen, SEXP Depth, SEXP Divide) {
+  if (!isString(Fen) || length(Fen) != 1 || STRING_ELT(Fen, 0) == NA_STRING) {
+    error("`fen` must be a single string.");
+  }
+  const int depth = asInteger(Depth);
+  if (depth == NA_INTEGER || depth < 0) {
+    error("`depth` must be a nonnegative integer.");
+  }
+  Chessboard Board;
+  Color sideToMove = WHITE;
+  const char * msg = parse_fen(&Board, &sideToMove, CHAR(STRING_ELT(Fen, 0)), NULL);
+  if (msg) {
+    error("Invalid FEN: %s.", msg);
+  }
+
+  if (!asLogical(Divide) || depth == 0) {
+    // nodes can exceed 2^31 so return a double
+    return ScalarReal((double)perft(&Board, sideToMove, depth));
+  }
+
+  MoveList list;
+  uint64_t nodes[MOVELIST_SIZE];
+  int n = divide(&Board, sideToMove, depth, &list, nodes);
+  SEXP ans = PROTECT(allocVector(VECSXP, 2));
+  SEXP moves = PROTECT(allocVector(STRSXP, n));
+  SEXP counts = PROTECT(allocVector(REALSXP, n));
+  double * countsp = REAL(counts);
+  for (int i = 0; i < n; ++i) {
+    char uci[6];
+    move16_to_uci(list.moves[i], uci);
+    SET_STRING_ELT(moves, i, mkChar(uci));
+    countsp[i] = (double)nodes[i];
+  }
+  SET_VECTOR_ELT(ans, 0, moves);
+  SET_VECTOR_ELT(ans, 1, counts);
+  UNPROTECT(3);
+  return ans;
+}
@@ -0,0 +1,508 @@
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+#include "chess.h"
+#include <stdlib.h>
+
+// Portable Game Notation, read from a memory-mapped file. Tags and moves are
+// read where they lie in the file: only the values of the tags asked for are
+// copied, into the strings of the result. Each game is replayed as it is
+// read, from the starting position or from its FEN tag, and its moves are
+// checked to be legal. Comments, variations, NAGs and move numbers are
+// skipped; a game ends at its result or at the tags of the next game.
+
+#define PGN_NA UINT32_MAX // the length of a tag that is absent
+#define PGN_CHUNKS_PER_THREAD 16 // so that no one chunk holds up the rest
+
+typedef struct {
+  const char * data;
+  size_t size;
+#ifdef _WIN32
+  HANDLE file;
+  HANDLE mapping;
+#else
+  int fd;
+#endif
+} PgnFile;
+
+// Where a tag's value, quotes removed, lies in the file
+typedef struct {
+  size_t offset;
+  uint32_t len;
+} PgnSpan;
+
+typedef struct {
+  int outcome;
+  int error;
+  int ply;
+} PgnResult;
+
+// The games read so far: ntags spans and a result each
+typedef struct {
+  PgnResult * results;
+  PgnSpan * tags;
+  size_t n;
+  size_t capacity;
+  int ntags;
+  bool failed; // out of memory
+} PgnGames;
+
+// Map the file at path. Returns NULL, or what went wrong.
+static const char * pgn_map(PgnFile * F, const char * path) {
+  F->data = NULL;
+  F->size = 0;
+#ifdef _WIN32
+  F->mapping = NULL;
+  F->file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+  if (F->file == INVALID_HANDLE_VALUE) {
+    return "cannot be opened";
+  }
+  LARGE_INTEGER size;
+  if (!GetFileSizeEx(F->file, &size)) {
+    CloseHandle(F->file);
+    return "cannot be read";
+  }
+  F->size = (size_t)size.QuadPart;
+  if (F->size == 0) {
+    return NULL;
+  }
+  F->mapping = CreateFileMappingA(F->file, NULL, PAGE_READONLY, 0, 0, NULL);
+  if (F->mapping == NULL) {
+    CloseHandle(F->file);
+    return "cannot be mapped";
+  }
+  F->data = (const char *)MapViewOfFile(F->mapping, FILE_MAP_READ, 0, 0, 0);
+  if (F->data == NULL) {
+    CloseHandle(F->mapping);
+    CloseHandle(F->file);
+    return "cannot be mapped";
+  }
+#else
+  F->fd = open(path, O_RDONLY);
+  if (F->fd < 0) {
+    return "cannot be opened";
+  }
+  struct stat st;
+  if (fstat(F->fd, &st) != 0) {
+    close(F->fd);
+    return "cannot be read";
+  }
+  F->size = (size_t)st.st_size;
+  if (F->size == 0) {
+    return NULL;
+  }
+  void * data = mmap(NULL, F->size, PROT_READ, MAP_PRIVATE, F->fd, 0);
+  if (data == MAP_FAILED) {
+    close(F->fd);
+    return "cannot be mapped";
+  }
+  posix_madvise(data, F->size, POSIX_MADV_SEQUENTIAL);
+  F->data = (const char *)data;
+#endif
+  return NULL;
+}
+
+static void pgn_unmap(PgnFile * F) {
+#ifdef _WIN32
+  if (F->data) {
+    UnmapViewOfFile(F->data);
+  }
+  if (F->mapping) {
+    CloseHandle(F->mapping);
+  }
+  CloseHandle(F->file);
+#else
+  if (F->data) {
+    munmap((void *)F->data, F->size);
+  }
+  close(F->fd);
+#endif
+}
+
+// Room for one more game
+static bool pgn_reserve(PgnGames * P) {
+  if (P->n < P->capacity) {
+    return true;
+  }
+  size_t capacity = P->capacity ? 2 * P->capacity : 1024;
+  PgnResult * results = realloc(P->results, capacity * sizeof(PgnResult));
+  if (results == NULL) {
+    return false;
+  }
+  P->results = results;
+  PgnSpan * tags = realloc(P->tags, capacity * (P->ntags ? P->ntags : 1) * sizeof(PgnSpan));
+  if (tags == NULL) {
+    return false;
+  }
+  P->tags = tags;
+  P->capacity = capacity;
+  return true;
+}
+
+static inline const char * skip_space(const char * p, const char * end) {
+  while (p < end && isspace((unsigned char)*p)) {
+    ++p;
+  }
+  return p;
+}
+
+static inline const char * skip_line(const char * p, const char * end) {
+  while (p < end && *p != '\n') {
+    ++p;
+  }
+  return p;
+}
+
+// Past a variation, p at its '(', and any within it
+static const char * skip_variation(const char * p, const char * end) {
+  int depth = 0;
+  for (; p < end; ++p) {
+    if (*p == '{') {
+      while (p < end && *p != '}') {
+        ++p;
+      }
+    } else if (*p == ';') {
+      p = skip_line(p, end);
+    } else if (*p == '(') {
+      ++depth;
+    } else if (*p == ')' && --depth == 0) {
+      return p + 1;
+    }
+    if (p == end) {
+      break;
+    }
+  }
+  return end;
+}
+
+static inline bool ends_token(char c) {
+  return isspace((unsigned char)c) || c == '{' || c == '}' || c == '(' || c == ')' || c == ';' || c == '[';
+}
+
+static inline bool is_result(const char * t, size_t n) {
+  return (n == 1 && t[0] == '*') || (n == 3 && (memcmp(t, "1-0", 3) == 0 || memcmp(t, "0-1", 3) == 0)) ||
+    (n == 7 && memcmp(t, "1/2-1/2", 7) == 0);
+}
+
+// Read the tag pair after the '[' at p, keeping its value if it is one of
+// tag_names or the FEN. Returns the end of the pair.
+static const char * read_tag(const char * p, const char * end, const char * base, const char ** tag_names,
+                             int ntags, PgnSpan * tags, PgnSpan * fen) {
+  const char * name = ++p;
+  while (p < end && !isspace((unsigned char)*p) && *p != '"' && *p != ']') {
+    ++p;
+  }
+  const size_t name_len = p - name;
+  p = skip_space(p, end);
+  const char * value = p;
+  size_t value_len = 0;
+  if (p < end && *p == '"') {
+    value = ++p;
+    while (p < end && *p != '"' && *p != '\n') {
+      p += (*p == '\\' && p + 1 < end) ? 2 : 1;
+    }
+    value_len = p - value;
+  }
+  while (p < end && *p != ']' && *p != '\n') {
+    ++p;
+  }
+  p += p < end && *p == ']';
+  if (value_len >= PGN_NA) {
+    return p;
+  }
+  PgnSpan span = {(size_t)(value - base), (uint32_t)value_len};
+  for (int j = 0; j < ntags; ++j) {
+    if (strncmp(tag_names[j], name, name_len) == 0 && tag_names[j][name_len] == '\0') {
+      tags[j] = span;
+    }
+  }
+  if (name_len == 3 && memcmp(name, "FEN", 3) == 0) {
+    *fen = span;
+  }
+  return p;
+}
+
+// Read and replay the games in [p, end), base the start of the file,
+// appending them to P. Raises no error, so any thread may read its part.
+static void pgn_parse(const char * p, const char * end, const char * base, const char ** tag_names, Game * G,
+                      PgnGames * P) {
+  const int ntags = P->ntags;
+  while ((p = skip_space(p, end)) < end) {
+    if (!pgn_reserve(P)) {
+      P->failed = true;
+      return;
+    }
+    PgnSpan * tags = P->tags + P->n * ntags;
+    for (int j = 0; j < ntags; ++j) {
+      tags[j].offset = 0;
+      tags[j].len = PGN_NA;
+    }
+    PgnSpan fen = {0, PGN_NA};
+    while (p < end && (*p == '[' || *p == '%')) {
+      p = (*p == '[') ? read_tag(p, end, base, tag_names, ntags, tags, &fen) : skip_line(p, end);
+      p = skip_space(p, end);
+    }
+
+    int err = SAN_OK;
+    int ply = 0;
+    if (fen.len == PGN_NA) {
+      initialize_Game(G);
+    } else {
+      char buf[2 * FEN_MAX];
+      if (fen.len >= sizeof(buf)) {
+        err = GAME_FEN;
+      } else {
+        memcpy(buf, base + fen.offset, fen.len);
+        buf[fen.len] = '\0';
+        err = initialize_Game_fen(G, buf) ? GAME_FEN : SAN_OK;
+      }
+    }
+
+    // the moves, to the result or the next game's tags
+    while ((p = skip_space(p, end)) < end && *p != '[') {
+      if (*p == '{') {
+        while (p < end && *p != '}') {
+          ++p;
+        }
+        p += p < end;
+        continue;
+      }
+      if (*p == ';' || (*p == '%' && (p == base || p[-1] == '\n'))) {
+        p = skip_line(p, end);
+        continue;
+      }
+      if (*p == '(') {
+        p = skip_variation(p, end);
+        continue;
+      }
+      const char * t = p;
+      while (p < end && !ends_token(*p)) {
+        ++p;
+      }
+      if (p == t) {
+        ++p; // a stray ')' or '}'
+        continue;
+      }
+      if (is_result(t, p - t)) {
+        break;
+      }
+      if (*t == '$' || *t == '.') {
+        continue; // a NAG, or the dots of "1... e5"
+      }
+      // a move number, maybe run into its move as in "1.e4"
+      const char * q = t;
+      while (q < p && isdigit((unsigned char)*q)) {
+        ++q;
+      }
+      if (q > t && (q == p || *q == '.')) {
+        while (q < p && *q == '.') {
+          ++q;
+        }
+        t = q;
+        if (t == p) {
+          continue;
+        }
+      }
+      if (err != SAN_OK) {
+        continue;
+      }
+      char san[16];
+      if ((size_t)(p - t) >= sizeof(san)) {
+        err = SAN_MALFORMED;
+      } else {
+        memcpy(san, t, p - t);
+        san[p - t] = '\0';
+        err = play_san(G, san);
+      }
+      ++ply;
+    }
+
+    PgnResult * r = &(P->results[P->n++]);
+    r->error = err;
+    r->ply = ply;
+    r->outcome = err == SAN_OK ? board2outcome(&(G->Board)) : NA_INTEGER;
+  }
+}
+
+// The value of a tag as an R string, any escaped quotes and backslashes
+// unescaped
+static SEXP span2string(const char * base, PgnSpan span) {
+  if (span.len == PGN_NA) {
+    return NA_STRING;
+  }
+  const char * value = base + span.offset;
+  if (memchr(value, '\\', span.len) == NULL) {
+    return mkCharLen(value, (int)span.len);
+  }
+  char * buf = R_alloc(span.len, 1);
+  int n = 0;
+  for (uint32_t i = 0; i < span.len; ++i) {
+    if (value[i] == '\\' && i + 1 < span.len) {
+      ++i;
+    }
+    buf[n++] = value[i];
+  }
+  return mkCharLen(buf, n);
+}
+
+// Is q, in the file from base, at the start of a line after a blank line?
+static bool after_blank_line(const char * q, const char * base) {
+  if (q == base || q[-1] != '\n') {
+    return q == base;
+  }
+  const char * r = q - 1;
+  while (r > base && (r[-1] == ' ' || r[-1] == '\t' || r[-1] == '\r')) {
+    --r;
+  }
+  return r == base || r[-1] == '\n';
+}
+
+// The first game boundary at or after p, a blank line followed by "[Event",
+// else end
+static const char * next_game(const char * p, const char * end, const char * base) {
+  while (p < end && (p = memchr(p, '[', end - p)) != NULL) {
+    if (end - p >= 6 && memcmp(p, "[Event", 6) == 0 && after_blank_line(p, base)) {
+      return p;
+    }
+    ++p;
+  }
+  return end;
+}
+
+static void free_chunks(PgnGames * chunks, int n) {
+  for (int k = 0; k < n; ++k) {
+    free(chunks[k].results);
+    free(chunks[k].tags);
+  }
+}
+
+// What C_ReadPgn() has read, to be put into R vectors and released
+typedef struct {
+  PgnFile * F;
+  PgnGames * chunks;
+  int nchunks;
+  int ntags;
+  const char * path;
+} PgnRead;
+
+// The result of C_ReadPgn() from its chunks, as R_UnwindProtect()'s body
+static SEXP pgn_result(void * data) {
+  const PgnRead * r = (const PgnRead *)data;
+  const PgnGames * chunks = r->chunks;
+  const int nchunks = r->nchunks;
+  const int ntags = r->ntags;
+  R_xlen_t N = 0;
+  for (int k = 0; k < nchunks; ++k) {
+    if (chunks[k].failed) {
+      error("Out of memory reading '%s'.", r->path);
+    }
+    N += chunks[k].n;
+  }
+
+  SEXP ans = PROTECT(allocVector(VECSXP, ntags + 4));
+  SEXP Game_ = PROTECT(allocVector(INTSXP, N));
+  SEXP Outcome = PROTECT(allocVector(INTSXP, N));
+  SEXP Error = PROTECT(allocVector(INTSXP, N));
+  SEXP Ply = PROTECT(allocVector(INTSXP, N));
+  R_xlen_t i = 0;
+  for (int k = 0; k < nchunks; ++k) {
+    for (size_t g = 0; g < chunks[k].n; ++g, ++i) {
+      INTEGER(Game_)[i] = (int)(i + 1);
+      INTEGER(Outcome)[i] = chunks[k].results[g].outcome;
+      INTEGER(Error)[i] = chunks[k].results[g].error;
+      INTEGER(Ply)[i] = chunks[k].results[g].ply;
+    }
+  }
+  SET_VECTOR_ELT(ans, 0, Game_);
+  for (int j = 0; j < ntags; ++j) {
+    SEXP values = PROTECT(allocVector(STRSXP, N));
+    i = 0;
+    for (int k = 0; k < nchunks; ++k) {
+      for (size_t g = 0; g < chunks[k].n; ++g, ++i) {
+        SET_STRING_ELT(values, i, span2string(r->F->data, chunks[k].tags[g * ntags + j]));
+      }
+    }
+    SET_VECTOR_ELT(ans, j + 1, values);
+    UNPROTECT(1);
+  }
+  SET_VECTOR_ELT(ans, ntags + 1, Outcome);
+  SET_VECTOR_ELT(ans, ntags + 2, Error);
+  SET_VECTOR_ELT(ans, ntags + 3, Ply);
+  UNPROTECT(5);
+  return ans;
+}
+
+// R_UnwindProtect()'s cleanup, run whether or not pgn_result() jumped
+static void pgn_cleanup(void * data, Rboolean jump) {
+  (void)jump;
+  PgnRead * r = (PgnRead *)data;
+  pgn_unmap(r->F);
+  free_chunks(r->chunks, r->nchunks);
+}
+
+// Games from the PGN file at path: their number in the file, the values of
+// the tags named, NA if absent, and as games2outcome() their outcome, error
+// code and the plies replayed. The file is split at game boundaries into
+// many more chunks than threads, handed out to the threads as they finish
+// the last, each thread reading with its own Game; the chunks' games are
+// put back in the order of the file.
+SEXP C_ReadPgn(SEXP Path, SEXP Tags, SEXP nthreads) {
+  if (!isString(Path) || length(Path) != 1 || STRING_ELT(Path, 0) == NA_STRING) {
+    error("`file` must be a single string.");
+  }
+  if (!isString(Tags)) {
+    error("`tags` must be a character vector.");
+  }
+  int nThread = asInteger(nthreads);
+  if (nThread == NA_INTEGER || nThread < 1) {
+    error("`nThread` must be a positive integer.");
+  }
+#ifndef _OPENMP
+  nThread = 1;
+#endif
+  const int ntags = length(Tags);
+  const char ** tag_names = (const char **)R_alloc(ntags ? ntags : 1, sizeof(const char *));
+  for (int j = 0; j < ntags; ++j) {
+    if (STRING_ELT(Tags, j) == NA_STRING) {
+      error("`tags` must not be NA.");
+    }
+    tag_names[j] = CHAR(STRING_ELT(Tags, j));
+  }
+  const char * path = CHAR(STRING_ELT(Path, 0));
+  // all that R allocates before the file is mapped
+  const int nchunks = nThread > 1 ? nThread * PGN_CHUNKS_PER_THREAD : 1;
+  const char ** bounds = (const char **)R_alloc(nchunks + 1, sizeof(const char *));
+  PgnGames * chunks = (PgnGames *)R_alloc(nchunks, sizeof(PgnGames));
+  memset(chunks, 0, nchunks * sizeof(PgnGames));
+  Game * games = (Game *)R_alloc(nThread, sizeof(Game));
+  SEXP cont = PROTECT(R_MakeUnwindCont());
+  PgnFile F;
+  const char * msg = pgn_map(&F, path);
+  if (msg) {
+    error("File '%s' %s.", path, msg);
+  }
+
+  const char * end = F.data + F.size;
+  bounds[0] = F.data;
+  for (int k = 1; k < nchunks; ++k) {
+    const char * p = F.data + (size_t)((double)F.size * k / nchunks);
+    bounds[k] = next_game(p > bounds[k - 1] ? p : bounds[k - 1], end, F.data);
+  }
+  bounds[nchunks] = end;
+#pragma omp parallel for num_threads(nThread) schedule(dynamic)
+  for (int k = 0; k < nchunks; ++k) {
+    chunks[k].ntags = ntags;
+    pgn_parse(bounds[k], bounds[k + 1], F.data, tag_names, &games[thread_num()], &chunks[k]);
+  }
+  PgnRead r = {&F, chunks, nchunks, ntags, path};
+  // every R allocation from here on may longjmp, and must not leak the
+  // mapping or the chunks
+  SEXP ans = R_UnwindProtect(pgn_result, &r, pgn_cleanup, &r, cont);
+  UNPROTECT(1);
+  return ans;
+}
@@ -0,0 +1,249 @@
+#include "chess.h"
+#include <stdlib.h>
+
+// Proof-number search for mates too deep for a fixed-depth search. The tree
+// is grown one leaf at a time, always at a most-proving node: the leaf whose
+// solving would most cheaply bring the root closer to proof or disproof.
+// Attacker nodes (OR) need one child proven, defender nodes (AND) all.
+//
+// Nodes hold only the move that reaches them; the position is recovered by
+// playing the moves down from the root. The tree is bounded by a node
+// budget, and by PNS_MAX_PLIES: lines longer than that, and lines that
+// repeat a position, are taken as no mate.
+
+#define PN_INF 0x3fffffffU
+
+typedef struct {
+  uint32_t pn; // proof number: leaves to prove to prove this node
+  uint32_t dn; // disproof number
+  uint32_t parent;
+  uint32_t child; // index of the first child, the rest following; 0 if leaf
+  uint16_t nchildren;
+  Move16 move; // the move from the parent
+} PNNode;
+
+typedef struct {
+  PNNode * nodes;
+  uint64_t n; // nodes in use
+  uint64_t capacity;
+  uint64_t max_nodes;
+} PNTree;
+
+static inline uint32_t pn_add(uint32_t a, uint32_t b) {
+  return (a >= PN_INF - b) ? PN_INF : a + b;
+}
+
+// Room for k more nodes, growing the array as needed up to the budget
+static bool reserve(PNTree * T, uint64_t k) {
+  if (T->n + k > T->max_nodes) {
+    return false;
+  }
+  if (T->n + k > T->capacity) {
+    uint64_t capacity = T->capacity ? T->capacity : 1024;
+    while (capacity < T->n + k) {
+      capacity *= 2;
+    }
+    if (capacity > T->max_nodes) {
+      capacity = T->max_nodes;
+    }
+    PNNode * nodes = realloc(T->nodes, capacity * sizeof(PNNode));
+    if (nodes == NULL) {
+      return false;
+    }
+    T->nodes = nodes;
+    T->capacity = capacity;
+  }
+  return true;
+}
+
+// Proof and disproof numbers for a new node, side to move: a defender with
+// no moves is mated or stalemated; otherwise each of its replies must be
+// answered, so its mobility estimates the work to prove it. Likewise each of
+// the attacker's moves must be refuted to disprove an attacker node.
+static void evaluate(PNNode * x, const Chessboard * board, Color side, bool attacker) {
+  MoveList list;
+  int nm = generateMoves(board, side, &list);
+  if (nm == 0) {
+    bool mated = !attacker && isKingInCheck(board, side);
+    x->pn = mated ? 0 : PN_INF;
+    x->dn = mated ? PN_INF : 0;
+  } else {
+    x->pn = attacker ? 1 : (uint32_t)nm;
+    x->dn = attacker ? (uint32_t)nm : 1;
+  }
+}
+
+// Grow the children of leaf i, the position on the board, side to move.
+// The attacker's checks come first, to be preferred among equals.
+static bool expand(PNTree * T, uint32_t i, Chessboard * board, Color side, bool attacker,
+                   const uint64_t * path, int ply) {
+  MoveList list;
+  int nm;
+  if (attacker) {
+    nm = generateChecks(board, side, &list);
+    MoveList rest;
+    int nr = generateMoves(board, side, &rest);
+    for (int j = 0; j < nr; ++j) {
+      if (!givesCheck(board, side, rest.moves[j])) {
+        list.moves[nm++] = rest.moves[j];
+      }
+    }
+  } else {
+    nm = generateMoves(board, side, &list);
+  }
+  if (!reserve(T, nm)) {
+    return false;
+  }
+  const Color other = (side == WHITE) ? BLACK : WHITE;
+  uint32_t first = (uint32_t)T->n;
+  T->n += nm;
+  T->nodes[i].child = first;
+  T->nodes[i].nchildren = (uint16_t)nm;
+  for (int j = 0; j < nm; ++j) {
+    PNNode * x = &T->nodes[first + j];
+    x->parent = i;
+    x->child = 0;
+    x->nchildren = 0;
+    x->move = list.moves[j];
+    Undo u;
+    make_move(board, x->move, &u);
+    bool repeated = false;
+    for (int q = ply - 1; q >= 0 && !repeated; q -= 2) {
+      repeated = path[q] == board->key;
+    }
+    if (repeated || ply + 1 >= PNS_MAX_PLIES) {
+      x->pn = PN_INF;
+      x->dn = 0;
+    } else {
+      evaluate(x, board, other, !attacker);
+    }
+    unmake_move(board, x->move, &u);
+  }
+  return true;
+}
+
+static void update(PNTree * T, uint32_t i, bool attacker) {
+  PNNode * x = &T->nodes[i];
+  const PNNode * c = &T->nodes[x->child];
+  uint32_t pn = attacker ? PN_INF : 0;
+  uint32_t dn = attacker ? 0 : PN_INF;
+  for (int j = 0; j < x->nchildren; ++j) {
+    if (attacker) {
+      pn = c[j].pn < pn ? c[j].pn : pn;
+      dn = pn_add(dn, c[j].dn);
+    } else {
+      pn = pn_add(pn, c[j].pn);
+      dn = c[j].dn < dn ? c[j].dn : dn;
+    }
+  }
+  x->pn = pn;
+  x->dn = dn;
+}
+
+// The number of plies in which the proven node i mates, the attacker
+// choosing the quickest proven mate and the defender the slowest
+static int mate_plies(const PNTree * T, uint32_t i, bool attacker, uint32_t * next) {
+  const PNNode * x = &T->nodes[i];
+  int o = attacker ? PNS_MAX_PLIES : -1;
+  *next = 0;
+  for (int j = 0; j < x->nchildren; ++j) {
+    uint32_t c = x->child + j;
+    if (T->nodes[c].pn != 0) {
+      continue;
+    }
+    uint32_t ignored;
+    int d = mate_plies(T, c, !attacker, &ignored);
+    if (attacker ? d < o : d > o) {
+      o = d;
+      *next = c;
+    }
+  }
+  return x->nchildren ? o + 1 : 0;
+}
+
+// Does the side to move have a forced mate, within max_nodes nodes and the
+// limits, if any? Returns 1 if proven, with the mating line, of at most
+// PNS_MAX_PLIES plies, in line[0..*len); 0 if disproven; -1 if the budget
+// ran out first.
+int pn_search(Chessboard * board, Color sideToMove, uint64_t max_nodes, SearchLimits * limits,
+              Move16 * line, int * len, uint64_t * nodes) {
+  PNTree T = {0};
+  T.max_nodes = max_nodes < PN_INF ? max_nodes : PN_INF;
+  *len = 0;
+  *nodes = 0;
+  if (!reserve(&T, 1)) {
+    return -1;
+  }
+  T.n = 1;
+  PNNode * root = &T.nodes[0];
+  root->parent = 0;
+  root->child = 0;
+  root->nchildren = 0;
+  root->move = 0;
+  evaluate(root, board, sideToMove, true);
+
+  const Color other = (sideToMove == WHITE) ? BLACK : WHITE;
+  uint64_t path[PNS_MAX_PLIES];
+  Undo undo[PNS_MAX_PLIES];
+  bool exhausted = false;
+  uint64_t reported = T.n;
+  while (T.nodes[0].pn != 0 && T.nodes[0].dn != 0) {
+    if (limits && T.n - reported >= LIMITS_PERIOD) {
+      if (limits_spent(limits, T.n - reported)) {
+        break;
+      }
+      reported = T.n;
+    }
+    // down to a most-proving node
+    uint32_t i = 0;
+    int ply = 0;
+    bool attacker = true;
+    while (T.nodes[i].nchildren) {
+      const PNNode * x = &T.nodes[i];
+      uint32_t best = x->child;
+      for (int j = 1; j < x->nchildren; ++j) {
+        const PNNode * c = &T.nodes[x->child + j];
+        if (attacker ? c->pn < T.nodes[best].pn : c->dn < T.nodes[best].dn) {
+          best = x->child + j;
+        }
+      }
+      path[ply] = board->key;
+      make_move(board, T.nodes[best].move, &undo[ply++]);
+      i = best;
+      attacker = !attacker;
+    }
+    path[ply] = board->key;
+    if (!expand(&T, i, board, attacker ? sideToMove : other, attacker, path, ply)) {
+      exhausted = true;
+    } else {
+      update(&T, i, attacker);
+    }
+    // back up to the root, updating the ancestors
+    while (i != 0) {
+      unmake_move(board, T.nodes[i].move, &undo[--ply]);
+      i = T.nodes[i].parent;
+      attacker = !attacker;
+      if (!exhausted) {
+        update(&T, i, attacker);
+      }
+    }
+    if (exhausted) {
+      break;
+    }
+  }
+
+  int o = T.nodes[0].pn == 0 ? 1 : (T.nodes[0].dn == 0 ? 0 : -1);
+  if (o == 1) {
+    uint32_t i = 0;
+    bool attacker = true;
+    uint32_t next;
+    while (mate_plies(&T, i, attacker, &next) > 0 && next) {
+      line[(*len)++] = T.nodes[next].move;
+      i = next;
+      attacker = !attacker;
+    }
+  }
+  *nodes = T.n;
+  free(T.nodes);
+  return o;
+}
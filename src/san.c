@@ -0,0 +1,139 @@
+#include "chess.h"
+
+// Moves in standard algebraic notation: "e4", "exd5", "Nbd7", "R1e2",
+// "e8=Q", "O-O-O". The 'x' and '=' are optional, as are any trailing '+',
+// '#', '!' and '?', so that moves stripped of them read the same. Moves in
+// coordinates ("e2e4", "g1f3", "e7e8q") read too: with both the file and
+// rank of the origin and no piece letter, any piece may move, and the
+// promotion letter may be lower case. A move is found
+// by matching it against the legal moves, and so only if it is legal and
+// unambiguous. Nothing here raises an error, so it is safe on any thread.
+
+static Piece letter2piece(char c) {
+  switch (c) {
+  case 'K':
+    return KING;
+  case 'Q':
+    return QUEEN;
+  case 'R':
+    return ROOK;
+  case 'B':
+    return BISHOP;
+  case 'N':
+    return KNIGHT;
+  default:
+    return EMPTY;
+  }
+}
+
+int san2move16(const Chessboard * board, Color sideToMove, const char * san, Move16 * m) {
+  char buf[16];
+  int n = 0;
+  for (const char * c = san; *c; ++c) {
+    if (*c == 'x' || *c == '=' || *c == '+' || *c == '#' || *c == '!' || *c == '?') {
+      continue;
+    }
+    if (n == (int)sizeof(buf) - 1) {
+      return SAN_MALFORMED;
+    }
+    buf[n++] = *c;
+  }
+  buf[n] = '\0';
+
+  MoveList list;
+  int nm = generateMoves(board, sideToMove, &list);
+
+  if (buf[0] == 'O' || buf[0] == '0') {
+    unsigned int toCol;
+    if (strcmp(buf, "O-O") == 0 || strcmp(buf, "0-0") == 0) {
+      toCol = 6;
+    } else if (strcmp(buf, "O-O-O") == 0 || strcmp(buf, "0-0-0") == 0) {
+      toCol = 2;
+    } else {
+      return SAN_MALFORMED;
+    }
+    for (int i = 0; i < nm; ++i) {
+      if (MOVE16_KIND(list.moves[i]) == MOVE_CASTLING && p2col(MOVE16_TO(list.moves[i])) == toCol) {
+        *m = list.moves[i];
+        return SAN_OK;
+      }
+    }
+    return SAN_ILLEGAL;
+  }
+
+  Piece promoted = EMPTY;
+  if (n >= 3 && isdigit((unsigned char)buf[n - 2])) {
+    promoted = letter2piece(toupper((unsigned char)buf[n - 1]));
+    if (promoted == EMPTY || promoted == KING) {
+      return SAN_MALFORMED;
+    }
+    --n;
+  }
+  if (n < 2 || buf[n - 2] < 'a' || buf[n - 2] > 'h' || buf[n - 1] < '1' || buf[n - 1] > '8') {
+    return SAN_MALFORMED;
+  }
+  const unsigned int to = rowcol2p(buf[n - 1] - '1', buf[n - 2] - 'a');
+
+  Piece P = PAWN;
+  int i = 0;
+  if (isupper((unsigned char)buf[0])) {
+    P = letter2piece(buf[0]);
+    if (P == EMPTY) {
+      return SAN_MALFORMED;
+    }
+    i = 1;
+  }
+  int fromCol = -1, fromRow = -1;
+  for (; i < n - 2; ++i) {
+    if (buf[i] >= 'a' && buf[i] <= 'h' && fromCol < 0) {
+      fromCol = buf[i] - 'a';
+    } else if (buf[i] >= '1' && buf[i] <= '8' && fromRow < 0) {
+      fromRow = buf[i] - '1';
+    } else {
+      return SAN_MALFORMED;
+    }
+  }
+  if (P == PAWN && fromCol < 0) {
+    fromCol = p2col(to); // a pawn's capture always names its file
+  } else if (P == PAWN && fromRow >= 0) {
+    P = EMPTY; // coordinates, "g1f3": the origin square says which piece
+  }
+
+  int found = 0;
+  for (int j = 0; j < nm; ++j) {
+    const Move16 mj = list.moves[j];
+    const unsigned int from = MOVE16_FROM(mj);
+    if (MOVE16_TO(mj) != to || (MOVE16_KIND(mj) == MOVE_CASTLING && P != EMPTY) ||
+        (P != EMPTY && board->board[p2row(from)][p2col(from)].piece != P) ||
+        (fromCol >= 0 && (int)p2col(from) != fromCol) ||
+        (fromRow >= 0 && (int)p2row(from) != fromRow)) {
+      continue;
+    }
+    if (MOVE16_KIND(mj) == MOVE_PROMOTION) {
+      // an unnamed promotion is to a queen
+      if (MOVE16_PROMOTED(mj) != (promoted == EMPTY ? QUEEN : promoted)) {
+        continue;
+      }
+    } else if (promoted != EMPTY) {
+      continue;
+    }
+    *m = mj;
+    ++found;
+  }
+  return found == 1 ? SAN_OK : (found ? SAN_AMBIGUOUS : SAN_ILLEGAL);
+}
+
+const char * san_error_message(int code) {
+  switch (code) {
+  case SAN_OK:
+    return "no error";
+  case SAN_MALFORMED:
+    return "not a move in algebraic notation";
+  case SAN_ILLEGAL:
+    return "not a legal move";
+  case SAN_AMBIGUOUS:
+    return "ambiguous";
+  default:
+    return "unknown error";
+  }
+}
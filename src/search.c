@@ -0,0 +1,387 @@
+#include "chess.h"
+
+// Best-move search: negamax with alpha-beta pruning, deepening a ply at a
+// time, and a quiescence search of captures at the leaves so that no
+// position is judged in the middle of an exchange. Scores are in
+// centipawns for the side to move.
+
+// Piece-square bonuses, from White's side of the board with the eighth rank
+// first, so that White's square p is entry p ^ 56 and Black's is entry p.
+static const int16_t PST[7][64] = {
+  {0},
+  { // pawn
+     0,  0,  0,  0,  0,  0,  0,  0,
+    50, 50, 50, 50, 50, 50, 50, 50,
+    10, 10, 20, 30, 30, 20, 10, 10,
+     5,  5, 10, 25, 25, 10,  5,  5,
+     0,  0,  0, 20, 20,  0,  0,  0,
+     5, -5,-10,  0,  0,-10, -5,  5,
+     5, 10, 10,-20,-20, 10, 10,  5,
+     0,  0,  0,  0,  0,  0,  0,  0
+  },
+  { // knight
+   -50,-40,-30,-30,-30,-30,-40,-50,
+   -40,-20,  0,  0,  0,  0,-20,-40,
+   -30,  0, 10, 15, 15, 10,  0,-30,
+   -30,  5, 15, 20, 20, 15,  5,-30,
+   -30,  0, 15, 20, 20, 15,  0,-30,
+   -30,  5, 10, 15, 15, 10,  5,-30,
+   -40,-20,  0,  5,  5,  0,-20,-40,
+   -50,-40,-30,-30,-30,-30,-40,-50
+  },
+  { // bishop
+   -20,-10,-10,-10,-10,-10,-10,-20,
+   -10,  0,  0,  0,  0,  0,  0,-10,
+   -10,  0,  5, 10, 10,  5,  0,-10,
+   -10,  5,  5, 10, 10,  5,  5,-10,
+   -10,  0, 10, 10, 10, 10,  0,-10,
+   -10, 10, 10, 10, 10, 10, 10,-10,
+   -10,  5,  0,  0,  0,  0,  5,-10,
+   -20,-10,-10,-10,-10,-10,-10,-20
+  },
+  { // rook
+     0,  0,  0,  0,  0,  0,  0,  0,
+     5, 10, 10, 10, 10, 10, 10,  5,
+    -5,  0,  0,  0,  0,  0,  0, -5,
+    -5,  0,  0,  0,  0,  0,  0, -5,
+    -5,  0,  0,  0,  0,  0,  0, -5,
+    -5,  0,  0,  0,  0,  0,  0, -5,
+    -5,  0,  0,  0,  0,  0,  0, -5,
+     0,  0,  0,  5,  5,  0,  0,  0
+  },
+  { // queen
+   -20,-10,-10, -5, -5,-10,-10,-20,
+   -10,  0,  0,  0,  0,  0,  0,-10,
+   -10,  0,  5,  5,  5,  5,  0,-10,
+    -5,  0,  5,  5,  5,  5,  0, -5,
+     0,  0,  5,  5,  5,  5,  0, -5,
+   -10,  5,  5,  5,  5,  5,  0,-10,
+   -10,  0,  5,  0,  0,  0,  0,-10,
+   -20,-10,-10, -5, -5,-10,-10,-20
+  },
+  { // king, while there are queens: behind its pawns
+   -30,-40,-40,-50,-50,-40,-40,-30,
+   -30,-40,-40,-50,-50,-40,-40,-30,
+   -30,-40,-40,-50,-50,-40,-40,-30,
+   -30,-40,-40,-50,-50,-40,-40,-30,
+   -20,-30,-30,-40,-40,-30,-30,-20,
+   -10,-20,-20,-20,-20,-20,-20,-10,
+    20, 20,  0,  0,  0,  0, 20, 20,
+    20, 30, 10,  0,  0, 10, 30, 20
+  }
+};
+
+// the king once the queens are off: to the centre
+static const int16_t KING_ENDGAME[64] = {
+  -50,-40,-30,-20,-20,-30,-40,-50,
+  -30,-20,-10,  0,  0,-10,-20,-30,
+  -30,-10, 20, 30, 30, 20,-10,-30,
+  -30,-10, 30, 40, 40, 30,-10,-30,
+  -30,-10, 30, 40, 40, 30,-10,-30,
+  -30,-10, 20, 30, 30, 20,-10,-30,
+  -30,-30,  0,  0,  0,  0,-30,-30,
+  -50,-30,-30,-30,-30,-30,-30,-50
+};
+
+static int placement(const Chessboard * board, Color C, bool endgame) {
+  const int flip = (C == WHITE) ? 56 : 0;
+  int o = 0;
+  for (int P = PAWN; P <= KING; ++P) {
+    const int16_t * table = (P == KING && endgame) ? KING_ENDGAME : PST[P];
+    uint64_t bb = board->pieceBB[C][P];
+    while (bb) {
+      o += table[pop_lsb(&bb) ^ flip];
+    }
+  }
+  return o;
+}
+
+// The static evaluation for side: material, as valued by total_material(),
+// and the placement of the pieces
+int evaluate_position(const Chessboard * board, Color side) {
+  const Color other = (side == WHITE) ? BLACK : WHITE;
+  const bool endgame = !(board->pieceBB[WHITE][QUEEN] | board->pieceBB[BLACK][QUEEN]);
+  return material_score(board, side) - material_score(board, other) +
+    placement(board, side, endgame) - placement(board, other, endgame);
+}
+
+static inline bool stopped(const Search * S) {
+  int o = 0;
+  if (S->limits) {
+#pragma omp atomic read
+    o = S->limits->out;
+  }
+  return o;
+}
+
+static inline bool stop_at_node(Search * S) {
+  if ((++S->nodes & (LIMITS_PERIOD - 1)) == 0 && S->limits) {
+    limits_spent(S->limits, LIMITS_PERIOD);
+  }
+  return stopped(S);
+}
+
+// Moves are tried in order of promise: the last principal variation's, then
+// the captures, the most valuable victim first and, of those, by the least
+// valuable attacker; then the killers, quiet moves that cut off at the same
+// ply elsewhere in the tree; then the other quiet moves, by how often they
+// have cut off before. The captures are generated first and the quiet
+// moves only once they are used up, so a node cut off by a capture never
+// generates the rest.
+enum {
+  STAGE_PV,
+  STAGE_CAPTURES,
+  STAGE_QUIETS,
+  STAGE_DONE
+};
+
+#define CAPTURE_SCORE (1 << 30)
+#define KILLER_SCORE (1 << 29)
+#define HISTORY_MAX (1 << 20) // history scores are halved beyond this
+
+typedef struct {
+  MoveList list;
+  int scores[MOVELIST_SIZE];
+  int i; // the next move in list
+  int stage;
+  bool captures_only;
+  Move16 pv_move; // 0 for none
+} MovePicker;
+
+static void picker_init(MovePicker * mp, Move16 pv_move, bool captures_only) {
+  mp->stage = STAGE_PV;
+  mp->i = 0;
+  mp->list.n = 0;
+  mp->captures_only = captures_only;
+  mp->pv_move = pv_move;
+  if (pv_move) {
+    mp->list.moves[mp->list.n++] = pv_move;
+  }
+}
+
+static int move_score(const Search * S, const Chessboard * board, Color side, int ply, Move16 m) {
+  const unsigned int from = MOVE16_FROM(m);
+  const unsigned int to = MOVE16_TO(m);
+  if (isCaptureOrPromotion(board, m)) {
+    const int attacker = board->board[from >> 3][from & 7].piece;
+    int victim = (MOVE16_KIND(m) == MOVE_ENPASSANT) ? PAWN : board->board[to >> 3][to & 7].piece;
+    if (MOVE16_KIND(m) == MOVE_PROMOTION) {
+      victim += MOVE16_PROMOTED(m);
+    }
+    return CAPTURE_SCORE + 8 * victim + KING - attacker;
+  }
+  if (m == S->killers[ply][0]) {
+    return KILLER_SCORE + 1;
+  }
+  if (m == S->killers[ply][1]) {
+    return KILLER_SCORE;
+  }
+  return S->history[side][from][to];
+}
+
+// The next move to search, 0 when there are no more
+static Move16 next_move(const Search * S, MovePicker * mp, const Chessboard * board, Color side, int ply) {
+  for (;;) {
+    if (mp->i < mp->list.n) {
+      // selection rather than a sort: after a cut-off the rest are never needed
+      int best = mp->i;
+      for (int j = mp->i + 1; j < mp->list.n; ++j) {
+        if (mp->scores[j] > mp->scores[best]) {
+          best = j;
+        }
+      }
+      Move16 m = mp->list.moves[best];
+      mp->list.moves[best] = mp->list.moves[mp->i];
+      mp->scores[best] = mp->scores[mp->i];
+      ++mp->i;
+      if (mp->stage != STAGE_PV && m == mp->pv_move) {
+        continue; // searched already
+      }
+      return m;
+    }
+    if (++mp->stage == STAGE_DONE || (mp->stage == STAGE_QUIETS && mp->captures_only)) {
+      return 0;
+    }
+    mp->i = 0;
+    if (mp->stage == STAGE_CAPTURES) {
+      generateCaptures(board, side, &mp->list);
+    } else {
+      generateQuiets(board, side, &mp->list);
+    }
+    for (int j = 0; j < mp->list.n; ++j) {
+      mp->scores[j] = move_score(S, board, side, ply, mp->list.moves[j]);
+    }
+  }
+}
+
+// A quiet move cut off: remember it at this ply, and the deeper the search
+// it cut off, the more it counts
+static void update_quiet_cutoff(Search * S, Color side, int depth, int ply, Move16 m) {
+  if (S->killers[ply][0] != m) {
+    S->killers[ply][1] = S->killers[ply][0];
+    S->killers[ply][0] = m;
+  }
+  int32_t * h = &S->history[side][MOVE16_FROM(m)][MOVE16_TO(m)];
+  *h += depth * depth;
+  if (*h > HISTORY_MAX) {
+    for (int i = 0; i < 64 * 64; ++i) {
+      (&S->history[side][0][0])[i] /= 2;
+    }
+  }
+}
+
+// The principal variation from ply is m followed by that from ply + 1
+static inline void update_pv(Search * S, int ply, Move16 m) {
+  S->pv[ply][ply] = m;
+  for (int i = ply + 1; i < S->pv_len[ply + 1]; ++i) {
+    S->pv[ply][i] = S->pv[ply + 1][i];
+  }
+  S->pv_len[ply] = S->pv_len[ply + 1];
+}
+
+// Captures and promotions only, the side to move free to stand pat, unless
+// it is in check, when every evasion is tried
+static int quiesce(Search * S, Chessboard * board, Color side, int ply, int alpha, int beta) {
+  S->pv_len[ply] = ply;
+  if (stop_at_node(S)) {
+    return 0;
+  }
+  if (ply >= SEARCH_MAX_PLY - 1) {
+    return evaluate_position(board, side);
+  }
+  const bool in_check = isKingInCheck(board, side);
+  if (!in_check) {
+    int stand_pat = evaluate_position(board, side);
+    if (stand_pat >= beta) {
+      return beta;
+    }
+    if (stand_pat > alpha) {
+      alpha = stand_pat;
+    }
+  }
+  // in check, the captures stage is every evasion
+  MovePicker mp;
+  picker_init(&mp, 0, true);
+  const Color other = (side == WHITE) ? BLACK : WHITE;
+  int nm = 0;
+  Move16 m;
+  while ((m = next_move(S, &mp, board, side, ply))) {
+    ++nm;
+    Undo u;
+    make_move(board, m, &u);
+    int score = -quiesce(S, board, other, ply + 1, -beta, -alpha);
+    unmake_move(board, m, &u);
+    if (stopped(S)) {
+      return 0;
+    }
+    if (score > alpha) {
+      alpha = score;
+      update_pv(S, ply, m);
+      if (score >= beta) {
+        return beta;
+      }
+    }
+  }
+  if (nm == 0 && in_check) {
+    return -SCORE_MATE + ply;
+  }
+  return alpha;
+}
+
+// The score of the position within [alpha, beta], searching depth plies
+// more. on_pv is whether the moves to here are the last iteration's
+// principal variation, whose next move is then searched first.
+static int negamax(Search * S, Chessboard * board, Color side, int depth, int ply,
+                   int alpha, int beta, bool on_pv) {
+  S->pv_len[ply] = ply;
+  if (stop_at_node(S)) {
+    return 0;
+  }
+  const bool in_check = isKingInCheck(board, side);
+  if (in_check) {
+    ++depth; // no check is left to the quiescence search
+  }
+  if (depth <= 0) {
+    return quiesce(S, board, side, ply, alpha, beta);
+  }
+  if (ply >= SEARCH_MAX_PLY - 1) {
+    return evaluate_position(board, side);
+  }
+  // the last principal variation leads to the same position, where its
+  // next move is legal
+  MovePicker mp;
+  picker_init(&mp, (on_pv && ply < S->prev_pv_len) ? S->prev_pv[ply] : 0, false);
+  const Color other = (side == WHITE) ? BLACK : WHITE;
+  int nm = 0;
+  Move16 m;
+  while ((m = next_move(S, &mp, board, side, ply))) {
+    const bool quiet = !isCaptureOrPromotion(board, m);
+    const bool pv_child = nm++ == 0 && mp.pv_move;
+    Undo u;
+    make_move(board, m, &u);
+    int score = -negamax(S, board, other, depth - 1, ply + 1, -beta, -alpha, pv_child);
+    unmake_move(board, m, &u);
+    if (stopped(S)) {
+      return 0;
+    }
+    if (score > alpha) {
+      alpha = score;
+      update_pv(S, ply, m);
+      if (score >= beta) {
+        if (quiet) {
+          update_quiet_cutoff(S, side, depth, ply, m);
+        }
+        return beta;
+      }
+    }
+  }
+  if (nm == 0) {
+    return in_check ? -SCORE_MATE + ply : 0;
+  }
+  return alpha;
+}
+
+// The best move for the side to move, searching depth plies and then the
+// captures, deepening a ply at a time until done or out of budget. Returns
+// the number of plies of the principal variation, in line[0..*len), with
+// the score for the side to move in *score; *depth_reached is the depth of
+// the last search completed. With no legal move, *len is 0 and the score
+// that of mate or stalemate. Should the budget run out before the first
+// search completes, the line is just the first legal move, unscored.
+int search_best_move(Search * S, Chessboard * board, Color sideToMove, int depth,
+                     Move16 * line, int * len, int * score, int * depth_reached) {
+  MoveList list;
+  *len = 0;
+  *depth_reached = 0;
+  S->nodes = 0;
+  S->prev_pv_len = 0;
+  memset(S->killers, 0, sizeof(S->killers));
+  memset(S->history, 0, sizeof(S->history));
+  if (generateMoves(board, sideToMove, &list) == 0) {
+    *score = isKingInCheck(board, sideToMove) ? -SCORE_MATE : 0;
+    return 0;
+  }
+  line[0] = list.moves[0];
+  *len = 1;
+  *score = 0;
+  if (depth > SEARCH_MAX_PLY - 1) {
+    depth = SEARCH_MAX_PLY - 1;
+  }
+  for (int d = 1; d <= depth; ++d) {
+    int s = negamax(S, board, sideToMove, d, 0, -SCORE_INF, SCORE_INF, true);
+    if (stopped(S)) {
+      break;
+    }
+    *score = s;
+    *depth_reached = d;
+    *len = S->pv_len[0];
+    for (int i = 0; i < *len; ++i) {
+      line[i] = S->prev_pv[i] = S->pv[0][i];
+    }
+    S->prev_pv_len = *len;
+    if (s >= SCORE_MATE - d || s <= -SCORE_MATE + d) {
+      break; // a mate within the horizon is exact
+    }
+  }
+  return *len;
+}
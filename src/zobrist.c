@@ -0,0 +1,28 @@
+#include "chess.h"
+
+// Zobrist keys: a position's key is the XOR of the keys of its features,
+// so it can be updated incrementally as pieces come and go.
+// Keys for EMPTY and for no castling rights are zero.
+
+uint64_t ZobristPiece[2][7][64];
+uint64_t ZobristCastling[2][4];
+uint64_t ZobristEnPassant[8];
+uint64_t ZobristSide;
+
+void init_zobrist(void) {
+  uint64_t seed = 0x2545F4914F6CDD1DULL;
+  for (int c = 0; c < 2; ++c) {
+    for (int P = 1; P < 7; ++P) {
+      for (int p = 0; p < 64; ++p) {
+        ZobristPiece[c][P][p] = prng64(&seed);
+      }
+    }
+    for (int rights = 1; rights < 4; ++rights) {
+      ZobristCastling[c][rights] = prng64(&seed);
+    }
+  }
+  for (int j = 0; j < 8; ++j) {
+    ZobristEnPassant[j] = prng64(&seed);
+  }
+  ZobristSide = prng64(&seed);
+}